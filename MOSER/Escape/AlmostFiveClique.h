@@ -2,263 +2,96 @@
 #define ESCAPE_ALMOSTFIVECLIQUE_H_
 
 #include <algorithm>
+#include <vector>
 
 #include "Escape/ErrorCode.h"
 #include "Escape/Graph.h"
 #include "Escape/Digraph.h"
 #include "Escape/Triadic.h"
 #include "Escape/Utils.h"
+#include "Escape/Parallel.h"
 
 using namespace Escape;
 
-// Requires gfull to be sorted by vertex ID
-EdgeIdx almostFiveClique(CGraph *gsorted)
+// Almost-five-clique (K5 minus an edge) counter
+// Input: A graph g sorted by vertex ID, and its degree ordered out-DAG gout
+// Output: The number of non-induced almost-five-cliques
+//
+// Every almost-five-clique has a unique triangle T whose three vertices are adjacent to both
+// remaining vertices. So the count is the sum over triangles T of {c_T \choose 2}, where c_T is
+// the number of vertices adjacent to all of T (that is, the number of 4-cliques containing T).
+//
+// Each triangle is handled at the DAG edge (i,j) between its lowest and highest vertex. The common
+// neighbors S of i and j are found by intersecting their sorted lists, and the edges inside S are
+// found from the out-lists of S, using stamp marks. Then c_T for T = (i,k,j) is the degree of k
+// inside S, for every k of S that lies between i and j in the degree order.
+// The edges of gout are processed in parallel, with per-thread marks.
+
+EdgeIdx almostFiveClique(CGraph *g, CGraph *gout)
 {
     EdgeIdx ret = 0;
-    int DEBUG = 0;
+    int nthreads = numThreads();
 
-    EdgeIdx *triangles = new VertexIdx[gsorted->nEdges+1];
-    VertexIdx count = 0;
-
-    for (VertexIdx i=0; i < gsorted->nVertices; i++)
+    // before(a,b) iff a comes before b in the degree order of degreeOrdered
+    auto before = [&](VertexIdx a, VertexIdx b)
     {
-        VertexIdx degi = gsorted->offsets[i+1] - gsorted->offsets[i];
-        for (EdgeIdx pos = gsorted->offsets[i]; pos < gsorted->offsets[i+1]; pos++)
-        {
-            VertexIdx j = gsorted->nbors[pos];
-            VertexIdx degj = gsorted->offsets[j+1] - gsorted->offsets[j];
-            
-            if (degj < degi || (degj == degi && j < i))
-                continue;
-            count = 0;
-
-            if (DEBUG)
-                printf("Processing %lld %lld\n",i,j);
-
-            for (EdgeIdx ptr = gsorted->offsets[i]; ptr < gsorted->offsets[i+1]; ptr++)
-            {
-                VertexIdx nbr = gsorted->nbors[ptr];
-//                 VertexIdx degnbr = gsorted->offsets[nbr+1] - gsorted->offsets[nbr];
-                if (DEBUG)
-                    printf("Looking for %lld %lld\n",nbr,j);
-                if (gsorted->getEdgeBinary(nbr,j) != -1)
-                {
-                    triangles[count] = nbr;
-                    if (DEBUG)
-                        printf("Found triangle %lld %lld %lld\n",i,j,nbr);
-                    count++;
-                }
-            }
-
-            std::sort(triangles,triangles+count);
-
-
-            for (VertexIdx ptr = 0; ptr < count; ptr++)
-            {
-                VertexIdx nbr = triangles[ptr];
-                VertexIdx degnbr = gsorted->offsets[nbr+1] - gsorted->offsets[nbr];
-
-                if (degj < degnbr || (degj == degnbr && j < nbr))
-                    continue;
-                if (degnbr < degi || (degnbr == degi && nbr < i))
-                    continue;
-
-                if (DEBUG)
-                    printf("Looking at %lld %lld %lld\n",i,j,nbr);
-
-                VertexIdx fourclique = 0;
-                
-                if (count < degnbr)
-                {
-                    if (DEBUG)
-                        printf("triangles < degnbr\n");
-                    for (VertexIdx ptr2 = 0; ptr2 < count; ptr2++)
-                    {
-                        if (DEBUG)
-                            printf("Looking for edge between %lld %lld\n",triangles[ptr2],nbr);
-                        if (gsorted->getEdgeBinary(triangles[ptr2],nbr) != -1)
-                        {
-                            if (DEBUG)
-                            {
-                                printf("Four-clique %lld %lld %lld %lld\n",i,j,nbr,triangles[ptr2]);
-                            }
-                            fourclique++;
-                        }
-                    }
-                }
-                else
-                {
-                    if (DEBUG)
-                        printf("triangles >= degnbr\n");
-                    for (VertexIdx next = gsorted->offsets[nbr]; next < gsorted->offsets[nbr+1]; next++)
-                    {
-                        if (binarySearch(triangles,count,gsorted->nbors[next]) != -1)
-                        {
-                            fourclique++;
-                            if (DEBUG)
-                                printf("Four-clique %lld %lld %lld %lld\n",i,j,gsorted->nbors[next],triangles[binarySearch(triangles,count,gsorted->nbors[next])]);
-                        }
-                    }
-                }
-                if (DEBUG)
-                    printf("Fourclique = %lld\n",fourclique);
-                ret += fourclique*(fourclique-1)/2;
-            }
-        }
-    }
-
-    if (DEBUG)
-        printf("Total found %lld\n",ret);
-//     return ret - 10*fivecliques;
-    return ret;
-}
-
-// Requires gfull to be sorted by vertex ID
-EdgeIdx oldAlmostFiveClique(CGraph *gsorted)
-{
-    EdgeIdx ret = 0;
-    int DEBUG = 0;
-
-    EdgeIdx *triangles = new VertexIdx[gsorted->nEdges+1];
-    VertexIdx count = 0;
-
-    for (VertexIdx i=0; i < gsorted->nVertices; i++)
+        VertexIdx dega = g->offsets[a+1] - g->offsets[a];
+        VertexIdx degb = g->offsets[b+1] - g->offsets[b];
+        return dega < degb || (dega == degb && a < b);
+    };
+
+    std::vector<std::vector<VertexIdx> > common(nthreads);  // common neighbors of the current edge
+    std::vector<EdgeIdx *> in_common(nthreads);             // in_common[v] == pos+1 iff v is in common, for the edge at pos
+    std::vector<VertexIdx *> common_deg(nthreads);          // degree of v inside common
+    std::vector<PaddedCount> partial(nthreads, PaddedCount{0, {}});
+    for (int t=0; t < nthreads; t++)
     {
-        for (EdgeIdx pos = gsorted->offsets[i]; pos < gsorted->offsets[i+1]; pos++)
-        {
-            VertexIdx j = gsorted->nbors[pos];
-            if (j < i)
-                continue;
-            count = 0;
-
-            if (DEBUG)
-                printf("Processing %lld %lld\n",i,j);
-
-            EdgeIdx jpos = gsorted->offsets[j];
-            for (EdgeIdx ipos = gsorted->offsets[i]; ipos < gsorted->offsets[i+1]; ipos++)
-            {
-                VertexIdx inbr = gsorted->nbors[ipos];
-                while(jpos < gsorted->offsets[j+1] && (gsorted->nbors[jpos] < inbr))
-                    jpos++;
-                if(gsorted->nbors[jpos] == inbr)
-                {
-                    triangles[count] = inbr;
-                    count++;
-                }
-            }
-
-            std::sort(triangles,triangles+count);
-
-            for (VertexIdx ptr = 0; ptr < count; ptr++)
-            {
-                VertexIdx k = triangles[ptr];
-                if (i > k || k > j)
-                    continue;
-                VertexIdx fourclique = 0;
-
-                for (VertexIdx ptr2 = 0; ptr2 < count; ptr2++)
-                {
-                    if(gsorted->isEdge(k,triangles[ptr2]) != -1)
-                    {
-                        if (DEBUG)
-                            printf("4-clique: %lld %lld %lld %lld\n",i,j,k,triangles[ptr2]);
-
-                        fourclique++;
-                    }
-                }
-                if (DEBUG)
-                    printf("Total for %lld %lld %lld is %lld\n",i,j,k,fourclique);
-                ret += fourclique*(fourclique-1)/2;
-            }
-        }
+        in_common[t] = new EdgeIdx[g->nVertices+1];
+        common_deg[t] = new VertexIdx[g->nVertices+1];
+        std::fill(in_common[t], in_common[t]+g->nVertices+1, 0);
     }
 
-    if (DEBUG)
-        printf("Total found %lld\n",ret);
-//     return ret - 10*fivecliques;
-    return ret;
-}
-
-
-EdgeIdx testingAlmostFiveClique(CGraph *gsorted)
-{
-    EdgeIdx ret = 0;
-    int DEBUG = 0;
-
-    EdgeIdx *triangles = new VertexIdx[gsorted->nEdges+1];
-    VertexIdx count = 0;
-    VertexIdx smaller, bigger;
-
-    for (VertexIdx i=0; i < gsorted->nVertices; i++)
+    parallelFor(0, gout->nEdges, 64, nthreads, [&](int tid, EdgeIdx pos)
     {
-        for (EdgeIdx pos = gsorted->offsets[i]; pos < gsorted->offsets[i+1]; pos++)
+        VertexIdx i = std::upper_bound(gout->offsets, gout->offsets+gout->nVertices+1, pos) - gout->offsets - 1; // edge (i,j) is at pos
+        VertexIdx j = gout->nbors[pos];
+
+        std::vector<VertexIdx> &S = common[tid];
+        S.clear();
+        intersectSorted(g->nbors+g->offsets[i], g->offsets[i+1]-g->offsets[i], g->nbors+g->offsets[j], g->offsets[j+1]-g->offsets[j], S);
+        if (S.size() < 3) // a triangle of S needs two other common neighbors
+            return;
+
+        EdgeIdx *mark = in_common[tid];
+        VertexIdx *deg = common_deg[tid];
+        for (VertexIdx t : S)
         {
-            VertexIdx j = gsorted->nbors[pos];
-            if (j < i)
-                continue;
-            count = 0;
-
-            if (DEBUG)
-                printf("Processing %lld %lld\n",i,j);
-
-            VertexIdx degi = gsorted->offsets[i+1] - gsorted->offsets[i];
-            VertexIdx degj = gsorted->offsets[j+1] - gsorted->offsets[j];
-
-            if (degi <= degj)
-            {
-                smaller = i;
-                bigger = j;
-            }
-            else
-            {
-                smaller = j;
-                bigger = i;
-            }
-
-            for (EdgeIdx ptr = gsorted->offsets[smaller]; ptr < gsorted->offsets[smaller+1]; ptr++)
+            mark[t] = pos+1;
+            deg[t] = 0;
+        }
+        for (VertexIdx t : S) // edges inside S
+            for (EdgeIdx next = gout->offsets[t]; next < gout->offsets[t+1]; ++next)
             {
-                VertexIdx nbr = gsorted->nbors[ptr];
-                if (nbr < i || nbr > j)
-                    continue;
-                if (gsorted->getEdgeBinary(nbr,bigger) != -1)
+                VertexIdx u = gout->nbors[next];
+                if (mark[u] == pos+1)
                 {
-                    triangles[count] = nbr;
-                    count++;
+                    deg[t]++;
+                    deg[u]++;
                 }
             }
 
-            std::sort(triangles,triangles+count);
+        for (VertexIdx k : S)
+            if (before(i,k) && before(k,j)) // T = (i,k,j) has lowest vertex i and highest vertex j
+                partial[tid].value += ((EdgeIdx) deg[k])*(deg[k]-1)/2;
+    });
 
-//             for (VertexIdx ptr = 0; ptr < count; ptr++)
-//             {
-//                 VertexIdx k = triangles[ptr];
-//                 if (i > k || k > j)
-//                     continue;
-//                 VertexIdx fourclique = 0;
-// 
-//                 for (VertexIdx ptr2 = 0; ptr2 < count; ptr2++)
-//                 {
-//                     if(gsorted->isEdge(k,triangles[ptr2]) != -1)
-//                     {
-//                         if (DEBUG)
-//                             printf("4-clique: %lld %lld %lld %lld\n",i,j,k,triangles[ptr2]);
-// 
-//                         fourclique++;
-//                     }
-//                 }
-//                 if (DEBUG)
-//                     printf("Total for %lld %lld %lld is %lld\n",i,j,k,fourclique);
-//                 ret += fourclique*(fourclique-1)/2;
-//             }
-        }
+    for (int t=0; t < nthreads; t++)
+    {
+        ret += partial[t].value;
+        delete[] in_common[t];
+        delete[] common_deg[t];
     }
-
-    if (DEBUG)
-        printf("Total found %lld\n",ret);
-//     return ret - 10*fivecliques;
     return ret;
 }
-#endif
-
-
 
+#endif
@@ -0,0 +1,745 @@
+#ifndef ESCAPE_CHAINDELTAS_H_
+#define ESCAPE_CHAINDELTAS_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "Escape/ChainProfile.h"
+#include "Escape/Conversion.h"
+#include "Escape/SwitchChain.h"
+
+using namespace Escape;
+
+// The steps of the edge switch chains (ATAC3, ATAC4, ATAC5) and the changes of the non-induced
+// 3-vertex, 4-vertex and 5-vertex counts when a single edge is deleted from or added to the chain
+// graph. The update functions are called before the graph changes: for a deletion the edge is
+// still in the graph, for an addition it is not yet.
+//
+// A switch keeps the number of edges, so the graph changes of a switch leave nEdges of the chain
+// graph alone, and the 4-vertex updates take the number of edges m at the time of the change.
+
+struct Edge
+{
+    int src;
+    int dst;
+    int idx;
+};
+
+struct FourInfo
+{
+    Count fourCycleCount;
+    Count fourCliqueCount;
+};
+
+bool isEdge(ChainGraph &cg, VertexIdx src, VertexIdx dst)
+{
+    return isChainEdge(cg, src, dst);
+}
+
+Count get_node_degree(ChainGraph &cg, VertexIdx node)
+{
+    return chainDegree(cg, node);
+}
+
+Count count_triangles_around_the_edge(ChainGraph &cg, Edge edge)
+{
+    return countEdgeTriangles(cg, edge.src, edge.dst);
+}
+
+Count count_3paths_around_the_edge(ChainGraph &cg, Edge edge)
+{
+    Count d = 0;
+    for (VertexIdx neighbour : cg.nbors[edge.src])
+        if (neighbour != edge.dst)
+            d += -get_node_degree(cg, neighbour) + 1;
+
+    for (VertexIdx neighbour : cg.nbors[edge.dst])
+        if (neighbour != edge.src)
+            d += -get_node_degree(cg, neighbour) + 1;
+    return d;
+}
+
+Count degree_on_one_hop_neighbourhood(ChainGraph &cg, Edge edge)
+{
+    Count degrees = 0;
+    forEachCommonNbor(cg, edge.src, edge.dst, [&](VertexIdx neighbour) { degrees += get_node_degree(cg, neighbour) - 2; });
+    return degrees;
+}
+
+Count edge_triangle_count_delta(ChainGraph &cg, Edge edge, bool add_mode = false)
+{
+    Count etd = 0; // edge_triangles_delta = (1 - triangles count around the edge)
+    forEachCommonNbor(cg, edge.src, edge.dst, [&](VertexIdx neighbour)
+    {
+        Edge candidate_1 = {edge.src, (int) neighbour};
+        Count triangles = count_triangles_around_the_edge(cg, candidate_1);
+        if (add_mode)
+            etd += triangles;
+        else
+            etd += 1 - triangles;
+
+        Edge candidate_2 = {edge.dst, (int) neighbour};
+        triangles = count_triangles_around_the_edge(cg, candidate_2);
+        if (add_mode)
+            etd += triangles;
+        else
+            etd += 1 - triangles;
+    });
+    return etd;
+}
+
+Count triangle_around_node(ChainGraph &cg, VertexIdx node, VertexIdx skip_node = -1)
+{
+    Count triangles = cg.vertexTris[node]; // tracked by the chain graph
+
+    // wedges (node, neighbour, skip_node) with node and skip_node not adjacent
+    Count skipped = 0;
+    if (skip_node >= 0 && skip_node != node && !isEdge(cg, node, skip_node))
+        forEachCommonNbor(cg, node, skip_node, [&](VertexIdx) { skipped++; });
+    return triangles + skipped;
+}
+
+FourInfo fourInfo_delta_calc(ChainGraph &cg, Edge edge)
+{
+    // 4-cycles (src, neighbour, other, dst): other is a common neighbor of neighbour and dst
+    Count cycles = 0;
+    for (VertexIdx neighbour : cg.nbors[edge.src])
+    {
+        if (neighbour == edge.dst)
+            continue;
+        forEachCommonNbor(cg, neighbour, edge.dst, [&](VertexIdx other)
+        {
+            if (other != edge.src)
+                cycles++;
+        });
+    }
+
+    // 4-cliques: edges between two common neighbors of src and dst
+    Count cliques = 0;
+    forEachCommonNbor(cg, edge.src, edge.dst, [&](VertexIdx neighbour)
+    {
+        forEachCommonNbor(cg, neighbour, edge.src, [&](VertexIdx other)
+        {
+            if (other != edge.dst && isEdge(cg, other, edge.dst))
+                cliques++;
+        });
+    });
+    FourInfo result = {cycles, cliques / 2};
+    return result;
+}
+
+// The 3-vertex and 4-vertex deltas are 128-bit integers, as are the counts they update: products of
+// degrees and of n overflow 64 bits (or lose exactness as doubles) on large graphs with hubs.
+void update_3node_deletion(ChainGraph &cg, Edge edge, WideCount (&delta)[4])
+{
+    WideCount n = cg.nVertices;
+    WideCount deg_src = get_node_degree(cg, edge.src);
+    WideCount deg_dst = get_node_degree(cg, edge.dst);
+
+    // gets the non-induced counts and update them
+    // 0. (n*(n-1)*(n-2))/6;  // number of independent sets (doesn't change)
+    delta[0] = 0;
+    // 1. m*(n-2);    // number of plain edges
+    delta[1] = -(n - 2);
+    // 2. w = w+(deg*(deg-1))/2; // updating total wedge count
+    // for the two ends of the edge degree reduced by one
+    delta[2] = -(deg_src + deg_dst - 2);
+    // 3. triangles, those on the edge
+    delta[3] = -count_triangles_around_the_edge(cg, edge);
+}
+
+void update_3node_addition(ChainGraph &cg, Edge edge, WideCount (&delta)[4])
+{
+    WideCount n = cg.nVertices;
+    WideCount deg_src = get_node_degree(cg, edge.src);
+    WideCount deg_dst = get_node_degree(cg, edge.dst);
+    // gets the non-induced counts and update them
+    // 0. (n*(n-1)*(n-2))/6;  // number of independent sets (doesn't change)
+    delta[0] = 0;
+    // 1. m*(n-2);    // number of plain edges
+    delta[1] = (n - 2);
+    // 2. w = w+(deg*(deg-1))/2; // updating total wedge count
+    // for the two ends of the edge degree reduced by one
+    delta[2] = deg_src + deg_dst;
+    // 3. triangles, those on the edge
+    delta[3] = count_triangles_around_the_edge(cg, edge);
+}
+
+void update_4node_deletion(ChainGraph &cg, Edge edge, WideCount (&nonInd3)[4], WideCount (&delta)[11], WideCount w1, WideCount t1, EdgeIdx m)
+{
+    // w1 is wedge count before deletion w2 is wedge count after deletion
+    // t1 is triangle count before deletion t2 is triangle count after deletion
+    WideCount n = cg.nVertices;
+    WideCount deg_src = get_node_degree(cg, edge.src);
+    WideCount deg_dst = get_node_degree(cg, edge.dst);
+    WideCount w2 = nonInd3[2];
+    WideCount t2 = nonInd3[3];
+
+    // nonInd[0] = (n*(n-1)*(n-2)*(n-3))/24;  // number of independent sets
+    delta[0] = 0;
+    // nonInd[1] = m*((n-2)*(n-3)/2);    // number of only edges
+    delta[1] = -((n - 2) * (n - 3) / 2);
+    // nonInd[2] = (m*(m-1)/2) - w; // number of matchings
+    delta[2] = w1 + 1 - m - w2;
+    // nonInd[3] = w*(n-3);        // number of only wedges
+    delta[3] = (w2 - w1) * (n - 3);
+    // nonInd[4] = t*(n-3);        // number of only triangles
+    delta[4] = (t2 - t1) * (n - 3);
+
+    // 3-stars: C(deg, 3) at both ends goes to C(deg - 1, 3)
+    delta[5] = -((deg_src - 1) * (deg_src - 2) / 2) - ((deg_dst - 1) * (deg_dst - 2) / 2);
+
+    delta[6] = count_3paths_around_the_edge(cg, edge) - ((deg_src - 1) * (deg_dst - 1)) - 3 * (t2 - t1);
+
+    // ret.tailedtris += (degi - 2) * info.perVertex[i];
+    WideCount sigma_neighbourhood_degrees = -degree_on_one_hop_neighbourhood(cg, edge);
+    // triangle count around the edge = t2-t1    // degree changes
+    WideCount src_change = (deg_src - 2) * (t2 - t1); // triangle_around_node_after_deletion(edge.src, edge, cg)
+    WideCount dst_change = (deg_dst - 2) * (t2 - t1);
+    WideCount tri_difference = triangle_around_node(cg, edge.src) + triangle_around_node(cg, edge.dst) - 2 * (t1 - t2); // triangle_around_node_after_deletion(edge.dst, edge, cg)
+    delta[7] = sigma_neighbourhood_degrees + src_change + dst_change - tri_difference;
+
+    // cycles
+    FourInfo res4 = fourInfo_delta_calc(cg, edge);
+    delta[8] = -res4.fourCycleCount;
+
+    WideCount t3 = t1 - t2;
+    delta[9] = -((t3 * (t3 - 1)) / 2) + edge_triangle_count_delta(cg, edge);
+
+    // cliques
+    delta[10] = -res4.fourCliqueCount;
+}
+
+void update_4node_addition(ChainGraph &cg, Edge edge, WideCount (&nonInd3)[4], WideCount (&delta)[11], WideCount w1, WideCount t1, EdgeIdx m)
+{
+    // w1 is wedge count before addition w2 is wedge count after addition
+    // t1 is triangle count before addition t2 is triangle count after addition
+    WideCount n = cg.nVertices;
+    WideCount deg_src = get_node_degree(cg, edge.src);
+    WideCount deg_dst = get_node_degree(cg, edge.dst);
+    WideCount w2 = nonInd3[2];
+    WideCount t2 = nonInd3[3];
+
+    // nonInd[0] = (n*(n-1)*(n-2)*(n-3))/24;  // number of independent sets
+    delta[0] = 0;
+    // nonInd[1] = m*((n-2)*(n-3)/2);    // number of only edges
+    delta[1] = (n - 2) * (n - 3) / 2;
+    // nonInd[2] = (m*(m-1)/2) - w; // number of matchings
+    delta[2] = m - (w2 - w1);
+    // nonInd[3] = w*(n-3);        // number of only wedges
+    delta[3] = (w2 - w1) * (n - 3);
+    // nonInd[4] = t*(n-3);        // number of only triangles
+    delta[4] = (t2 - t1) * (n - 3);
+
+    // 3-stars: C(deg, 3) at both ends goes to C(deg + 1, 3)
+    delta[5] = (deg_src * (deg_src - 1) / 2) + (deg_dst * (deg_dst - 1) / 2);
+
+    delta[6] = -count_3paths_around_the_edge(cg, edge) + ((deg_src * deg_dst)) - 3 * (t2 - t1);
+
+    // ret.tailedtris += (degi - 2) * info.perVertex[i];
+    WideCount sigma_neighbourhood_degrees = degree_on_one_hop_neighbourhood(cg, edge);
+    // triangle count around the edge = t2-t1    // degree changes
+    WideCount src_change = (deg_src - 2) * (t2 - t1); // triangle_around_node_after_deletion(edge.src, edge, cg)
+    WideCount dst_change = (deg_dst - 2) * (t2 - t1);
+    WideCount tri_difference = triangle_around_node(cg, edge.src, edge.dst) + triangle_around_node(cg, edge.dst, edge.src);
+    delta[7] = sigma_neighbourhood_degrees + src_change + dst_change + tri_difference;
+
+    // cycles
+    FourInfo res4 = fourInfo_delta_calc(cg, edge);
+    delta[8] = res4.fourCycleCount;
+
+    WideCount t3 = t2 - t1;
+    delta[9] = ((t3 * (t3 - 1)) / 2) + edge_triangle_count_delta(cg, edge, true);
+
+    // cliques
+    delta[10] = res4.fourCliqueCount;
+}
+
+void simulate_deletion_on_CG(ChainGraph &cg, Edge edge)
+{
+    unlinkChainEdge(cg, edge.src, edge.dst);
+}
+
+void simulate_addition_on_CG(ChainGraph &cg, Edge edge)
+{
+    linkChainEdge(cg, edge.src, edge.dst);
+}
+
+Edge random_edge_picker(ChainEdges &edges, Rng &rng)
+{
+    // picks a uniform random edge of the graph, in a random direction
+    VertexIdx src, dst;
+    Edge edge;
+    edge.idx = sampleChainEdge(edges, rng, src, dst);
+    edge.src = src;
+    edge.dst = dst;
+
+    return edge;
+}
+
+bool check_switch(ChainGraph &g, Edge ab, Edge cd)
+{
+    int a = ab.src, b = ab.dst, c = cd.src, d = cd.dst;
+    if (a == c || a == d || b == c || b == d)
+        return false;
+
+    // check ad or cb exists in graph or not
+    return !isChainEdge(g, a, d) && !isChainEdge(g, c, b);
+}
+
+Edge find_switch_candidate(ChainGraph &cg, ChainEdges &edges, Edge ab, Rng &rng, std::vector<VertexIdx> *tried = NULL, Count *drawn = NULL)
+{
+    Edge cd;
+    int RETRY_COUNT = 10;
+    while (RETRY_COUNT > 0)
+    {
+        cd = random_edge_picker(edges, rng);
+        if (drawn)
+            (*drawn)++;
+        if (tried)
+        {
+            tried->push_back(cd.src);
+            tried->push_back(cd.dst);
+        }
+        if (check_switch(cg, ab, cd))
+            break;
+        else
+            RETRY_COUNT--;
+    }
+    if (!RETRY_COUNT)
+        cd.src = -1;
+    return cd;
+}
+
+// Draws the two edges of the next switch, (a,b) and a (c,d) that can be switched with it. Returns
+// false if there is none (and then the chain stays where it is). With tried, the vertices that the
+// draws looked up in the graph are added to it. With profile, the draws are timed and the
+// candidates counted.
+bool pick_switch(ChainGraph &cg, ChainEdges &edges, Rng &rng, Edge &ab, Edge &cd, std::vector<VertexIdx> *tried = NULL, ChainProfile *profile = NULL)
+{
+    PhaseTimer timer(profile);
+    ab = random_edge_picker(edges, rng);
+    if (tried)
+    {
+        tried->push_back(ab.src);
+        tried->push_back(ab.dst);
+    }
+    timer.lap(phasePick);
+    cd = find_switch_candidate(cg, edges, ab, rng, tried, profile ? &profile->candidates : NULL);
+    timer.lap(phaseCandidates);
+    return cd.src != -1;
+}
+
+// Counts a step of the chain in profile (if any), which switched or not.
+void count_chain_step(ChainProfile *profile, bool switched)
+{
+    if (!profile)
+        return;
+    profile->steps++;
+    profile->rejected += !switched;
+}
+
+void update_counts_using_delta(WideCount *nonInd, const WideCount *delta, int size)
+{
+    for (int i = 0; i < size; i++)
+        nonInd[i] += delta[i];
+}
+
+void update_counts_using_delta(WideCount *nonInd, const Count *delta, int size)
+{
+    for (int i = 0; i < size; i++)
+        nonInd[i] += delta[i];
+}
+
+// Changes of the connected 5-vertex counts (patterns 13 to 33) when an edge {u,v} is deleted or added.
+// Only the copies on vertex sets S that contain u and v change, and only if G[S] with the edge is
+// connected. On such a set, the number of copies of a pattern goes from its number in G[S] without
+// the edge to its number in G[S] with the edge, and both only depend on the pattern of G[S]. So the
+// sets are counted by their adjacency mask, and the change of the counts is a sum over the masks.
+//
+// Listing the sets one by one takes about deg^3 steps for an edge at a hub of degree deg. Instead,
+// the connected 4-vertex sets T that contain u and v are listed (by growing them from {u,v}), and the
+// vertices x next to T are counted by the subset of T they are adjacent to. The counts for T follow
+// from those for its first three vertices and the neighbors of the fourth. Every vertex keeps bits for
+// the vertices of the set it is adjacent to, the vertices around the edge count their neighbors by
+// adjacency to u and v once per edge, and as the counts are linear, the fourth vertices are summed by
+// their adjacency to the first three. So for every third vertex, only the common neighbors with the
+// fourth vertices are left to find, and they are listed from the shorter lists.
+// A set S is found once for every x in S other than u and v such that G[S - x] is connected, a number
+// that only depends on the mask of S (and is at least 1, as G[S] has the edge {u,v}). Every time S
+// is found, it adds the change for its mask divided by that number.
+//
+// The vertices of a set are numbered 0 to 4 in the order they join it, u and v being 0 and 1, and the
+// pair {a,b} (a < b) is bit b(b-1)/2 + a of the mask. So bit 0 is the edge {u,v}, and the pairs of
+// vertex k with the vertices before it are the k bits from k(k-1)/2 on. Bit 0 is always set, and
+// the counting gives the same masks before and after the edge changes.
+
+// Returns whether the vertices in the bit set vertices are connected in the 5-vertex graph with the given mask.
+bool fiveMaskConnected(int mask, int vertices)
+{
+    int first = 0;
+    while (!(vertices & (1 << first)))
+        first++;
+    int reached = 1 << first, stack[5] = {first}, top = 1;
+    while (top > 0)
+    {
+        int a = stack[--top];
+        for (int b = 0; b < 5; b++)
+            if (a != b && (vertices & (1 << b)) && !(reached & (1 << b))
+                && (mask & (1 << (std::max(a, b) * (std::max(a, b) - 1) / 2 + std::min(a, b)))))
+            {
+                reached |= 1 << b;
+                stack[top++] = b;
+            }
+    }
+    return reached == vertices;
+}
+
+// Returns the pattern (13 to 33) of the 5-vertex graph with the given adjacency mask, or -1 if the
+// graph is not connected.
+int fiveMaskPattern(int mask)
+{
+    if (!fiveMaskConnected(mask, 31))
+        return -1;
+
+    bool adj[5][5] = {};
+    int deg[5] = {0, 0, 0, 0, 0};
+    for (int b = 1, bit = 0; b < 5; b++)
+        for (int a = 0; a < b; a++, bit++)
+            if (mask & (1 << bit))
+            {
+                adj[a][b] = adj[b][a] = true;
+                deg[a]++;
+                deg[b]++;
+            }
+
+    std::sort(deg, deg + 5);
+    int degrees = 0;
+    for (int a = 0; a < 5; a++)
+        degrees = 10 * degrees + deg[a];
+    int triangles = 0;
+    for (int a = 0; a < 5; a++)
+        for (int b = a + 1; b < 5; b++)
+            for (int c = b + 1; c < 5; c++)
+                triangles += adj[a][b] && adj[a][c] && adj[b][c];
+    for (int p = 0; p < 21; p++)
+        if (FivePatternDegrees[p][1] == degrees && FivePatternDegrees[p][2] == triangles)
+            return FivePatternDegrees[p][0];
+    return -1;
+}
+
+// Counts kept for a vertex y next to the candidates of the edge {u,v}, while the edge is counted.
+struct FifthSlot
+{
+    Count nextTo[4];    // nextTo[t]: neighbors of y that are candidates of type t (1 to 3), i.e. adjacent to u and v as t
+    Count later[4];     // later[t]: the same, among the third vertices done so far
+};
+
+struct FiveDeltaCounter
+{
+    int change[512][21];                // change[mask >> 1][H - 13]: copies of H in mask, minus those in mask without bit 0
+    int found[512];                     // found[mask >> 1]: number of times a set with that mask is found
+    std::vector<unsigned char> adj;     // adj[x]: bit k is set if x is adjacent to vertex k (< 3) of the current set
+    std::vector<VertexIdx> candidates;  // vertices adjacent to the current set, in the order they were found
+    std::vector<int> position;          // position[x]: 1 + position of x among the candidates next to u or v, or 0
+    Count sets[512];                    // sets[mask >> 1]: times a set was found with that mask
+    std::vector<int> masks;             // the masks (>> 1) with sets found
+    std::vector<int> slotOf;            // slotOf[y]: the slot of y in slots, or -1
+    std::vector<FifthSlot> slots;       // the slots of the vertices in slotVertices
+    std::vector<VertexIdx> slotVertices;
+};
+
+FiveDeltaCounter newFiveDeltaCounter(VertexIdx nVertices)
+{
+    FiveDeltaCounter ret;
+    for (int mask = 1; mask < 1024; mask += 2)
+    {
+        int with = fiveMaskPattern(mask), without = fiveMaskPattern(mask - 1);
+        for (int h = 0; h < 21; h++)
+            ret.change[mask >> 1][h] = (with < 0 ? 0 : FiveIndToNonMatrix[13 + h][with])
+                                    - (without < 0 ? 0 : FiveIndToNonMatrix[13 + h][without]);
+        ret.found[mask >> 1] = 0;
+        for (int x = 2; x < 5; x++)
+            ret.found[mask >> 1] += fiveMaskConnected(mask, 31 & ~(1 << x));
+        ret.sets[mask >> 1] = 0;
+    }
+    ret.adj.assign(nVertices, 0);
+    ret.position.assign(nVertices, 0);
+    ret.slotOf.assign(nVertices, -1);
+    return ret;
+}
+
+// Returns the slot of y, starting an empty one if y has none.
+FifthSlot &fifthSlot(FiveDeltaCounter &c, VertexIdx y)
+{
+    if (c.slotOf[y] < 0)
+    {
+        c.slotOf[y] = c.slots.size();
+        c.slotVertices.push_back(y);
+        c.slots.push_back(FifthSlot{{0, 0, 0, 0}, {0, 0, 0, 0}});
+    }
+    return c.slots[c.slotOf[y]];
+}
+
+// Sets hist to the neighbors of y other than u and v, counted by their adjacency to u and v (bits 0 and
+// 1 of adj). Those next to u or v are counted from the candidates once per edge, and the others are the rest.
+void fifthHistogram(const ChainGraph &g, const FiveDeltaCounter &c, VertexIdx y, Count (&hist)[4])
+{
+    hist[0] = g.nbors[y].size() - (c.adj[y] & 1) - ((c.adj[y] >> 1) & 1);
+    for (int type = 1; type < 4; type++)
+    {
+        hist[type] = c.slotOf[y] < 0 ? 0 : c.slots[c.slotOf[y]].nextTo[type];
+        hist[0] -= hist[type];
+    }
+}
+
+// Whether y is a candidate after the i-th: one next to u or v that comes later, or one next to the third
+// vertex only.
+bool laterCandidate(const FiveDeltaCounter &c, VertexIdx y, size_t i)
+{
+    return (c.adj[y] & 3) == 0 ? c.adj[y] != 0 : c.position[y] > (int) i + 1;
+}
+
+// Whether the edges between x and the neighbors nb of a third vertex are found from nb (looking them up
+// in the table of the hub x), rather than from the neighbors of x.
+bool scanFromThird(const ChainGraph &g, VertexIdx x, const std::vector<VertexIdx> &nb)
+{
+    return !g.tables[x].keys.empty() && nb.size() < g.nbors[x].size();
+}
+
+// Whether the edge from w to its k-th neighbor is known to be on no triangle (if triangles are tracked).
+bool noTriangle(const ChainGraph &g, VertexIdx w, size_t k)
+{
+    return g.trackTriangles && g.tris[w][k] == 0;
+}
+
+// Adds the common neighbors of set[2] and set[3] other than set[0] and set[1] to common, by their
+// adjacency to set[0] and set[1]. The shorter list is scanned: the neighbors of set[2] are marked in adj,
+// and those of a hub set[3] are in its table.
+void addCommonNeighbors(const ChainGraph &g, const FiveDeltaCounter &c, const VertexIdx (&set)[4], Count (&common)[4])
+{
+    const std::vector<VertexIdx> &nb2 = g.nbors[set[2]], &nb3 = g.nbors[set[3]];
+    if (!g.tables[set[3]].keys.empty() && nb2.size() < nb3.size())
+    {
+        for (VertexIdx x : nb2)
+            if (x != set[0] && x != set[1] && x != set[3] && findChainNbor(g, set[3], x) >= 0)
+                common[c.adj[x] & 3]++;
+    }
+    else
+    {
+        for (VertexIdx x : nb3)
+            if (x != set[0] && x != set[1] && (c.adj[x] & 4))
+                common[c.adj[x] & 3]++;
+    }
+}
+
+// Counts the sets made of a 4-vertex set (with adjacency mask) and a vertex next to it, for the fourths
+// 4-vertex sets with the same first three vertices and mask. below[type] is the number of vertices
+// outside the first three that are adjacent to exactly the vertices type of them. hist and common are
+// the sums over the fourth vertices of their neighbors other than the first three, by adjacency to the
+// first two: all of them (but the third) and those that are neighbors of the third.
+void countFifthVertices(FiveDeltaCounter &c, int mask, Count fourths, const Count (&hist)[4], const Count (&common)[4], const Count (&below)[8])
+{
+    int third = (mask >> 1) & 3, fourth = (mask >> 3) & 7;
+    Count byType[16];
+    for (int type = 0; type < 4; type++)
+    {
+        byType[type | 8] = hist[type] - common[type];
+        byType[type | 12] = common[type];
+    }
+    if (fourth & 4) // the third vertex is a neighbor of the fourth, but not a fifth vertex
+        byType[third | 8] -= fourths;
+    for (int type = 0; type < 8; type++)
+        byType[type] = fourths * below[type] - byType[type | 8];
+    byType[fourth] -= fourths;
+
+    for (int type = 1; type < 16; type++) // byType[0] is not a count of vertices next to the set
+        if (byType[type] > 0)
+        {
+            int set5 = (mask | (type << 6)) >> 1;
+            if (c.sets[set5] == 0)
+                c.masks.push_back(set5);
+            c.sets[set5] += byType[type];
+        }
+}
+
+// Sets delta to the change of the non-induced connected 5-vertex counts when the edge {u,v} is added
+// (the negation for a deletion). delta[0] to delta[12] are left at 0.
+void fiveEdgeDelta(const ChainGraph &g, FiveDeltaCounter &c, VertexIdx u, VertexIdx v, Count (&delta)[34])
+{
+    VertexIdx set[4] = {u, v, -1, -1};
+    for (int k = 0; k < 2; k++)
+        for (VertexIdx x : g.nbors[set[k]])
+            if (x != u && x != v)
+            {
+                if (c.adj[x] == 0)
+                    c.candidates.push_back(x);
+                c.adj[x] |= 1 << k;
+            }
+    Count nextToEdge[4] = {0, 0, 0, 0};
+    for (size_t i = 0; i < c.candidates.size(); i++)
+    {
+        VertexIdx w = c.candidates[i];
+        nextToEdge[c.adj[w]]++;
+        c.position[w] = i + 1;
+        for (VertexIdx x : g.nbors[w])
+            if (x != u && x != v)
+                fifthSlot(c, x).nextTo[c.adj[w]]++;
+    }
+
+    // The third vertex is a candidate, and the fourth a later candidate (which may be next to the third only).
+    // The fourth vertices are summed by their adjacency to the first three, as the counts are linear in them.
+    // The third vertices are taken from the last, so that the later candidates next to u or v are summed as
+    // they go, and only the neighbors of the third vertex change their sums.
+    size_t edgeCandidates = c.candidates.size();
+    Count laterFourths[4] = {0, 0, 0, 0}, laterHist[4][4] = {}; // the later candidates, by adjacency to u and v
+    for (size_t i = edgeCandidates; i-- > 0; )
+    {
+        set[2] = c.candidates[i];
+        Count below[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        for (int type = 0; type < 4; type++)
+            below[type] = nextToEdge[type];
+        below[c.adj[set[2]]]--;
+
+        Count fourths[8] = {0, 0, 0, 0, 0, 0, 0, 0}, hist[8][4] = {}, common[8][4] = {};
+        for (int fourth = 0; fourth < 4; fourth++)
+        {
+            fourths[fourth] = laterFourths[fourth];
+            for (int type = 0; type < 4; type++)
+                hist[fourth][type] = laterHist[fourth][type];
+        }
+        const std::vector<VertexIdx> &nb2 = g.nbors[set[2]];
+        Count laterPaths[4][4] = {}; // laterPaths[a][b]: paths set[2] - x - y, x of type a and y a later candidate of type b
+        EdgeIdx scans = 0;
+        for (size_t pos = 0; pos < nb2.size(); pos++)
+        {
+            VertexIdx x = nb2[pos];
+            if (x == u || x == v)
+                continue;
+            int type = c.adj[x];
+            if (!noTriangle(g, set[2], pos))
+                scans += scanFromThird(g, x, nb2) ? nb2.size() : g.nbors[x].size();
+            if (c.slotOf[x] >= 0)
+                for (int k = 1; k < 4; k++)
+                    laterPaths[type][k] += c.slots[c.slotOf[x]].later[k];
+            if (type == 0)
+                c.candidates.push_back(x);
+            below[type]--;
+            below[type | 4]++;
+            c.adj[x] |= 4;
+            if (laterCandidate(c, x, i)) // now next to the third vertex
+            {
+                Count h[4];
+                fifthHistogram(g, c, x, h);
+                fourths[type]--; // fourths[0] is not used, so new candidates (type 0) can leave it too
+                fourths[type | 4]++;
+                for (int k = 0; k < 4; k++)
+                {
+                    hist[type][k] -= h[k];
+                    hist[type | 4][k] += h[k];
+                }
+            }
+        }
+
+        // The common neighbors x of set[2] and the fourth vertices are found either from every fourth vertex
+        // (scanning the shorter list), or for all of them at once, whichever is shorter. The paths
+        // set[2] - x - y to a later y are counted as the third vertices get done, and those with y next to
+        // set[2] are the edges between its neighbors, listed from the shorter list.
+        EdgeIdx probes = (c.candidates.size() - i - 1) * std::min((VertexIdx) nb2.size(), hubDegree);
+        if (scans < probes)
+        {
+            Count inner[4][4] = {}; // inner[a][b]: edges x - y between neighbors of set[2], of types a and b, y later
+            for (size_t pos = 0; pos < nb2.size(); pos++)
+            {
+                VertexIdx x = nb2[pos];
+                if (x == u || x == v || noTriangle(g, set[2], pos))
+                    continue;
+                int type = c.adj[x] & 3;
+                if (scanFromThird(g, x, nb2))
+                {
+                    for (VertexIdx y : nb2)
+                        if (y != u && y != v && laterCandidate(c, y, i) && findChainNbor(g, x, y) >= 0)
+                            inner[type][c.adj[y] & 3]++;
+                }
+                else
+                {
+                    for (VertexIdx y : g.nbors[x])
+                        if ((c.adj[y] & 4) && laterCandidate(c, y, i))
+                            inner[type][c.adj[y] & 3]++;
+                }
+            }
+            for (int a = 0; a < 4; a++)
+                for (int b = 0; b < 4; b++)
+                {
+                    common[b][a] += laterPaths[a][b] - inner[a][b]; // laterPaths[a][0] is 0
+                    common[b | 4][a] += inner[a][b];
+                }
+        }
+        else
+        {
+            for (size_t j = i + 1; j < c.candidates.size(); j++)
+            {
+                set[3] = c.candidates[j];
+                addCommonNeighbors(g, c, set, common[c.adj[set[3]]]);
+            }
+        }
+        int mask = 1 | (c.adj[set[2]] << 1);
+        for (int fourth = 1; fourth < 8; fourth++) // a fourth vertex is next to one of the first three
+            if (fourths[fourth] > 0)
+                countFifthVertices(c, mask | (fourth << 3), fourths[fourth], hist[fourth], common[fourth], below);
+
+        for (VertexIdx x : g.nbors[set[2]])
+            c.adj[x] &= 3;
+        for (size_t j = edgeCandidates; j < c.candidates.size(); j++)
+            c.adj[c.candidates[j]] = 0;
+        c.candidates.resize(edgeCandidates);
+
+        // set[2] is a later candidate for the third vertices before it
+        Count h[4];
+        fifthHistogram(g, c, set[2], h);
+        laterFourths[c.adj[set[2]]]++;
+        for (int k = 0; k < 4; k++)
+            laterHist[c.adj[set[2]]][k] += h[k];
+        for (VertexIdx x : nb2)
+            if (x != u && x != v)
+                fifthSlot(c, x).later[c.adj[set[2]]]++;
+    }
+    for (VertexIdx x : c.candidates)
+    {
+        c.adj[x] = 0;
+        c.position[x] = 0;
+    }
+    c.candidates.clear();
+    for (VertexIdx y : c.slotVertices)
+        c.slotOf[y] = -1;
+    c.slotVertices.clear();
+    c.slots.clear();
+
+    for (int i = 0; i < 34; i++)
+        delta[i] = 0;
+    // a set is found 1, 2 or 3 times, possibly with different masks, so the sum is taken 6 times
+    for (int set5 : c.masks)
+    {
+        Count sets = c.sets[set5] * (6 / c.found[set5]);
+        for (int h = 0; h < 21; h++)
+            delta[13 + h] += sets * c.change[set5][h];
+        c.sets[set5] = 0;
+    }
+    for (int h = 13; h < 34; h++)
+        delta[h] /= 6;
+    c.masks.clear();
+}
+
+void update_5node_deletion(ChainGraph &cg, FiveDeltaCounter &fc, Edge edge, Count (&delta)[34])
+{
+    fiveEdgeDelta(cg, fc, edge.src, edge.dst, delta);
+    for (int i = 13; i < 34; i++)
+        delta[i] = -delta[i];
+}
+
+void update_5node_addition(ChainGraph &cg, FiveDeltaCounter &fc, Edge edge, Count (&delta)[34])
+{
+    fiveEdgeDelta(cg, fc, edge.src, edge.dst, delta);
+}
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef ESCAPE_CHAINPROFILE_H_
+#define ESCAPE_CHAINPROFILE_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "Escape/Graph.h"
+
+using namespace Escape;
+
+// Timing the phases of the switch chains (ATAC3, ATAC4, ATAC5 with --profile): drawing the first
+// edge of a switch, drawing candidates for the second one, the 3-, 4- and 5-vertex count changes,
+// the graph changes, and for batches of switches the drawing and making of a batch. Every phase has
+// a latency histogram, with the counts of steps, switches, steps without a switch, and candidates.
+//
+// The histograms are log-linear (as in HdrHistogram): values below 16 ns have a bucket each, and
+// every power of two above is cut into 16 buckets, so a bucket is within 1/16 of its values, and
+// the quantiles are within about 6%. Recording a time is a shift and an increment.
+//
+// Without a profile the timers do nothing, so the chains only pay for a null check per phase.
+
+enum ChainPhase
+{
+    phasePick,          // the first edge of a switch
+    phaseCandidates,    // the candidates for the second edge
+    phaseUpdate3,       // update_3node_*
+    phaseUpdate4,       // update_4node_*
+    phaseUpdate5,       // update_5node_*
+    phaseGraph,         // simulate_*_on_CG
+    phaseBatchDraw,     // drawing a batch of switches (with the first edges and candidates above)
+    phaseBatchMake,     // making a batch of switches in parallel (with the phases of the switches above)
+    nChainPhases
+};
+
+const char *const chainPhaseNames[nChainPhases] = {"edge_pick", "candidate_retries", "update_3node", "update_4node",
+                                                   "update_5node", "simulate", "batch_draw", "batch_make"};
+
+const int latencySubBuckets = 16;
+const int latencyBuckets = 61 * latencySubBuckets; // up to 2^64 ns
+
+struct LatencyHistogram
+{
+    std::vector<Count> buckets;
+    Count count;
+    uint64_t total, max;    // in ns
+};
+
+LatencyHistogram newLatencyHistogram()
+{
+    LatencyHistogram ret = {std::vector<Count>(latencyBuckets, 0), 0, 0, 0};
+    return ret;
+}
+
+inline int latencyBucket(uint64_t ns)
+{
+    if (ns < (uint64_t) latencySubBuckets)
+        return ns;
+    int exponent = 63 - __builtin_clzll(ns); // at least 4
+    return (exponent - 3) * latencySubBuckets + (int) ((ns >> (exponent - 4)) & (latencySubBuckets - 1));
+}
+
+// The largest value of bucket.
+uint64_t latencyBucketTop(int bucket)
+{
+    if (bucket < latencySubBuckets)
+        return bucket;
+    int exponent = bucket / latencySubBuckets + 3, sub = bucket % latencySubBuckets;
+    return ((uint64_t) (latencySubBuckets + sub + 1) << (exponent - 4)) - 1;
+}
+
+inline void addLatency(LatencyHistogram &h, uint64_t ns)
+{
+    h.buckets[latencyBucket(ns)]++;
+    h.count++;
+    h.total += ns;
+    h.max = std::max(h.max, ns);
+}
+
+// The q quantile (0 < q <= 1), up to the width of its bucket.
+uint64_t latencyQuantile(const LatencyHistogram &h, double q)
+{
+    Count rank = std::max<Count>(1, (Count) (q * h.count + 0.5)), seen = 0;
+    for (int b = 0; b < latencyBuckets; b++)
+    {
+        seen += h.buckets[b];
+        if (seen >= rank)
+            return std::min(latencyBucketTop(b), h.max);
+    }
+    return h.max;
+}
+
+void mergeLatencyHistogram(LatencyHistogram &h, const LatencyHistogram &other)
+{
+    for (int b = 0; b < latencyBuckets; b++)
+        h.buckets[b] += other.buckets[b];
+    h.count += other.count;
+    h.total += other.total;
+    h.max = std::max(h.max, other.max);
+}
+
+struct ChainProfile
+{
+    std::vector<LatencyHistogram> phases;   // by ChainPhase
+    Count steps;        // steps of the chain
+    Count rejected;     // steps without a switch (no candidate was found)
+    Count candidates;   // candidates drawn for the second edge
+};
+
+ChainProfile newChainProfile()
+{
+    ChainProfile ret = {std::vector<LatencyHistogram>(nChainPhases, newLatencyHistogram()), 0, 0, 0};
+    return ret;
+}
+
+void mergeChainProfile(ChainProfile &p, const ChainProfile &other)
+{
+    for (int phase = 0; phase < nChainPhases; phase++)
+        mergeLatencyHistogram(p.phases[phase], other.phases[phase]);
+    p.steps += other.steps;
+    p.rejected += other.rejected;
+    p.candidates += other.candidates;
+}
+
+// Times consecutive phases: lap(phase) adds the time since the last lap (or since the timer was made)
+// to phase. Does nothing without a profile.
+class PhaseTimer
+{
+public:
+    explicit PhaseTimer(ChainProfile *profile) : profile(profile)
+    {
+        if (profile)
+            last = std::chrono::steady_clock::now();
+    }
+
+    void lap(int phase)
+    {
+        if (!profile)
+            return;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        addLatency(profile->phases[phase], std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count());
+        last = now;
+    }
+
+private:
+    ChainProfile *profile;
+    std::chrono::steady_clock::time_point last;
+};
+
+// Writes the profile of a chain that ran for seconds as a JSON object: the counts, the switches per
+// second, and for every phase that ran its count, total and mean time, quantiles and maximum (in ns).
+void writeChainProfileJson(FILE *f, const ChainProfile &p, double seconds)
+{
+    Count switches = p.steps - p.rejected;
+    fprintf(f, "{\n  \"steps\": %lld,\n  \"switches\": %lld,\n  \"rejected\": %lld,\n  \"candidates\": %lld,\n",
+            (long long) p.steps, (long long) switches, (long long) p.rejected, (long long) p.candidates);
+    fprintf(f, "  \"seconds\": %.6f,\n  \"switches_per_second\": %.3f,\n  \"phases\": {", seconds, seconds > 0 ? switches / seconds : 0.0);
+    bool first = true;
+    for (int phase = 0; phase < nChainPhases; phase++)
+    {
+        const LatencyHistogram &h = p.phases[phase];
+        if (h.count == 0)
+            continue;
+        fprintf(f, "%s\n    \"%s\": {\"count\": %lld, \"total_ns\": %llu, \"mean_ns\": %.1f, \"p50_ns\": %llu, \"p90_ns\": %llu, "
+                   "\"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+                first ? "" : ",", chainPhaseNames[phase], (long long) h.count, (unsigned long long) h.total, (double) h.total / h.count,
+                (unsigned long long) latencyQuantile(h, 0.5), (unsigned long long) latencyQuantile(h, 0.9),
+                (unsigned long long) latencyQuantile(h, 0.99), (unsigned long long) latencyQuantile(h, 0.999), (unsigned long long) h.max);
+        first = false;
+    }
+    fprintf(f, "\n  }\n}\n");
+}
+
+#endif
@@ -0,0 +1,945 @@
+#ifndef ESCAPE_CHAINRUNNER_H_
+#define ESCAPE_CHAINRUNNER_H_
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Escape/ChainProfile.h"
+#include "Escape/Conversion.h"
+#include "Escape/GetAllCounts.h"
+#include "Escape/Parallel.h"
+#include "Escape/Random.h"
+#include "Escape/SwitchBatch.h"
+
+using namespace Escape;
+
+// Running the edge switch chains (ATAC3, ATAC4, ATAC5): the command line, the output files, and
+// several chains at once. The graph is loaded and counted once, and every chain starts from those
+// counts with its own copy of the chain graph and its own stream of the seed (chain k uses stream k),
+// so the chains are independent, and run on the thread pool at the same time.
+//
+// The counts of a chain are kept as one row: the 3-vertex counts, then the 4-vertex counts (ATAC4
+// and ATAC5), then the 5-vertex counts (ATAC5), in the order of out.txt.
+
+const int chainBlockWidth[3] = {4, 11, 34};
+
+// Rows are written in chunks of this many rows, so that long chains do not have to fit in memory.
+const int chainChunkRows = 50000;
+
+int chainRowLength(int maxSize)
+{
+    int ret = 0;
+    for (int size = 3; size <= maxSize; size++)
+        ret += chainBlockWidth[size - 3];
+    return ret;
+}
+
+// The K counts at row, as an array (for the count updates, which take arrays).
+template <int K>
+WideCount (&rowBlock(WideCount *row))[K]
+{
+    return *reinterpret_cast<WideCount (*)[K]>(row);
+}
+
+struct ChainOptions
+{
+    const char *graph;
+    std::vector<int> steps;     // one chain for every entry, with that many rows (the first row is the input graph)
+    bool induced;               // write induced counts instead of non-induced counts
+    bool serialTest;            // run the serial test and write p-values instead of the counts
+    bool stats;                 // write statistics of the rows (see ChainStatistics) instead of the rows
+    int reservoir;              // with stats, also write this many rows sampled uniformly along the chain
+    int batch;                  // switches drawn at a time, and made in parallel where they are far apart (see SwitchBatch.h)
+    int checkpoint;             // save every chain after this many rows (0: never)
+    bool resume;                // continue the chains from their checkpoints
+    int profile;                // time the phases of every chain, and write the profile after this many rows (0: never)
+    int check;                  // recount the chain graph after this many rows, and stop if the counts differ (0: never)
+    Count burnIn;               // switch steps made before the first row (not with serialTest)
+    int thin;                   // switch steps between consecutive rows
+    uint64_t seed;
+};
+
+const char chainUsage[] = "<graph> [steps[,steps...]] [-i] [--serial-test] [--stats] [--reservoir <rows>] [--batch <switches>] "
+                          "[--checkpoint <rows>] [--resume] [--profile <rows>] [--check <rows>] [--burn-in <steps>] [--thin <steps>] [--seed <seed>]";
+
+// Whether arg is a list of steps: numbers separated by single commas.
+bool isStepList(const char *arg)
+{
+    if (!isdigit((unsigned char) *arg))
+        return false;
+    for (const char *pos = arg; *pos != '\0'; pos++)
+        if (!isdigit((unsigned char) *pos) && !(*pos == ',' && isdigit((unsigned char) pos[1])))
+            return false;
+    return true;
+}
+
+// Usage: <exe> <graph> [steps[,steps...]] [-i] [--serial-test] [--stats] [--reservoir <rows>] [--batch <switches>] [--checkpoint <rows>] [--resume] [--profile <rows>] [--check <rows>] [--burn-in <steps>] [--thin <steps>] [--seed <seed>]
+//   steps: number of rows of the chain (default 10000), the first being the input graph.
+//          With a comma separated list, one chain is run for every entry, in parallel.
+//   -i: write induced counts instead of non-induced counts
+//   --serial-test: run the serial test over steps rows (see runSerialTest), and write the p-values
+//   --stats: write statistics of the rows of every chain instead of the rows (see writeChainStatistics)
+//   --reservoir <rows>: with the statistics, also write rows sampled uniformly along every chain (implies --stats)
+//   --batch <switches>: draw up to this many switches at a time, and make those that are far apart from each other
+//                       in parallel (the chain and its rows are the same as with one switch at a time)
+//   --checkpoint <rows>: save every chain after every this many rows, to its output path with .ckpt appended
+//   --resume: continue every chain from its checkpoint, if it has one (with the same arguments and seed)
+//   --profile <rows>: time the phases of the switches of every chain, and write the profile after every this many
+//                     rows and at the end, to its output path with .profile.json appended (see writeChainProfile)
+//   --check <rows>: recount the graph of every chain from scratch after every this many rows and after the last,
+//                   and stop if the tracked counts differ (see checkChainCounts; for testing, as a recount takes as long as the first)
+//   --burn-in <steps>: make this many switch steps before the first row (default 0: the first row is the input graph)
+//   --thin <steps>: make this many switch steps between consecutive rows (default 1), so that row i is the chain
+//                   after burn-in + i * thin steps (the counts are tracked at every step)
+//   --seed <seed>: seed of the random switches, so that the trajectories can be replayed
+//                  (by default a random seed, which is printed)
+// Prints the usage and exits on anything else (an unknown option, or an option without its argument).
+ChainOptions parseChainOptions(int argc, char *argv[])
+{
+    ChainOptions ret;
+    ret.graph = argv[1];
+    ret.induced = false;
+    ret.serialTest = false;
+    ret.stats = false;
+    ret.reservoir = 0;
+    ret.batch = 1;
+    ret.checkpoint = 0;
+    ret.resume = false;
+    ret.profile = 0;
+    ret.check = 0;
+    ret.burnIn = 0;
+    ret.thin = 1;
+    ret.seed = randomSeed();
+    for (int i = 2; i < argc; i++)
+        if (strcmp(argv[i], "-i") == 0)
+            ret.induced = true;
+        else if (strcmp(argv[i], "--serial-test") == 0)
+            ret.serialTest = true;
+        else if (strcmp(argv[i], "--stats") == 0)
+            ret.stats = true;
+        else if (strcmp(argv[i], "--reservoir") == 0 && i + 1 < argc)
+        {
+            ret.reservoir = std::max(0L, strtol(argv[++i], NULL, 10));
+            ret.stats = true;
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+            ret.batch = std::max(1L, strtol(argv[++i], NULL, 10));
+        else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc)
+            ret.checkpoint = std::max(0L, strtol(argv[++i], NULL, 10));
+        else if (strcmp(argv[i], "--resume") == 0)
+            ret.resume = true;
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+            ret.profile = std::max(0L, strtol(argv[++i], NULL, 10));
+        else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc)
+            ret.check = std::max(0L, strtol(argv[++i], NULL, 10));
+        else if (strcmp(argv[i], "--burn-in") == 0 && i + 1 < argc)
+            ret.burnIn = std::max(0LL, strtoll(argv[++i], NULL, 10));
+        else if (strcmp(argv[i], "--thin") == 0 && i + 1 < argc)
+            ret.thin = std::max(1L, strtol(argv[++i], NULL, 10));
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            ret.seed = strtoull(argv[++i], NULL, 10);
+        else if (isStepList(argv[i]))
+        {
+            ret.steps.clear();
+            for (char *pos = argv[i]; *pos != '\0'; )
+            {
+                char *end;
+                ret.steps.push_back(std::max(0L, strtol(pos, &end, 10)));
+                pos = (*end == ',') ? end + 1 : end + strlen(end);
+            }
+        }
+        else
+        {
+            printf("could not parse the argument %s (an unknown option, or an option without its value)\nUsage: %s %s\n", argv[i], argv[0], chainUsage);
+            exit(1);
+        }
+
+    if (ret.steps.empty())
+    {
+        printf("You can specify the number of steps!\n");
+        printf("The default value is 10K. \n");
+        ret.steps.push_back(10000);
+    }
+    printf("Seed: %llu\n", (unsigned long long) ret.seed);
+    return ret;
+}
+
+// The output of chain k: out.txt for a single chain, out_<k>.txt for several.
+std::string chainOutputPath(int chain, int nChains)
+{
+    if (nChains == 1)
+        return "out.txt";
+    return "out_" + std::to_string(chain) + ".txt";
+}
+
+// Writes nRows rows of counts (of sizes 3 to maxSize) to f, block by block: the 3-vertex rows, a separator
+// line, the 4-vertex rows, a separator line, and so on. With induced, the rows are converted to
+// induced counts first (exactly, in one batch).
+void writeChainRows(FILE *f, const WideCount *rows, int nRows, int maxSize, bool induced)
+{
+    int rowLength = chainRowLength(maxSize);
+    std::vector<WideCount> block, converted;
+    char buf[41];
+    for (int size = 3, offset = 0; size <= maxSize; offset += chainBlockWidth[size - 3], size++)
+    {
+        int width = chainBlockWidth[size - 3];
+        block.resize((size_t) nRows * width);
+        for (int i = 0; i < nRows; i++)
+            std::copy(rows + (size_t) i * rowLength + offset, rows + (size_t) i * rowLength + offset + width, block.begin() + (size_t) i * width);
+        if (induced)
+        {
+            converted.resize(block.size());
+            if (size == 3)
+                convertTrajectory(ThreeNonToIndMatrix, block.data(), converted.data(), nRows);
+            else if (size == 4)
+                convertTrajectory(FourNonToIndMatrix, block.data(), converted.data(), nRows);
+            else
+                convertTrajectory(FiveNonToIndMatrix, block.data(), converted.data(), nRows);
+            block.swap(converted);
+        }
+
+        for (int i = 0; i < nRows; i++)
+        {
+            for (int j = 0; j < width; j++)
+                fprintf(f, "%s ", formatWideCount(block[(size_t) i * width + j], buf));
+            fprintf(f, "\n");
+        }
+        fprintf(f, "-------------------------- \n");
+    }
+}
+
+// Converts a row of non-induced counts (of sizes 3 to maxSize) to induced counts.
+void inducedRow(const WideCount *row, WideCount *ind, int maxSize)
+{
+    convertTrajectory(ThreeNonToIndMatrix, row, ind, 1);
+    if (maxSize >= 4)
+        convertTrajectory(FourNonToIndMatrix, row + 4, ind + 4, 1);
+    if (maxSize >= 5)
+        convertTrajectory(FiveNonToIndMatrix, row + 15, ind + 15, 1);
+}
+
+// The graph of a chain, with the edges in edges, as a CGraph (sorted by id).
+CGraph chainEdgesCSR(VertexIdx nVertices, const ChainEdges &edges)
+{
+    EdgeIdx m = edges.src.size();
+    Graph g = {nVertices, 2 * m, new VertexIdx[2 * m], new VertexIdx[2 * m]};
+    for (EdgeIdx e = 0; e < m; e++)
+    {
+        g.srcs[2 * e] = g.dsts[2 * e + 1] = edges.src[e];
+        g.dsts[2 * e] = g.srcs[2 * e + 1] = edges.dst[e];
+    }
+    return makeCSR(g, true);
+}
+
+// Counts cg from scratch, as the first row of a chain (of sizes 3 to maxSize).
+void countChainRow(CGraph *cg, int maxSize, WideCount *row)
+{
+    CGraph relabel = cg->renameByDegreeOrder();
+    relabel.sortById();
+    CDAG dag = degreeOrdered(&relabel);
+    dag.outlist.sortById();
+    dag.inlist.sortById();
+
+    double three[4], four[11], five[34];
+    NoninducedFourCounts countedFour;
+    EdgeIdx countedFive[21];
+    TriangleInfo info = getAllThree(&relabel, &dag, three, true);
+    exactThree(&relabel, info, rowBlock<4>(row));
+    if (maxSize >= 4)
+    {
+        getAllFour(&relabel, &dag, four, info, &countedFour);
+        exactFour(&relabel, &dag, info, countedFour, rowBlock<11>(row + 4));
+    }
+    if (maxSize >= 5)
+    {
+        getAllFive(&relabel, &dag, four, five, info, allPatterns, &countedFour, countedFive);
+        exactFive(&relabel, rowBlock<4>(row), rowBlock<11>(row + 4), countedFive, rowBlock<34>(row + 15));
+    }
+    delTriangleInfo(info);
+    delCGraph(dag.outlist);
+    delCGraph(dag.inlist);
+    delCGraph(relabel);
+}
+
+// Recounts the graph of chain k from scratch, and stops the run if the counts it tracked in row (of
+// sizes 3 to maxSize, at row i) differ. In the middle of a batch, the graph has the switches of the
+// whole batch already, so the check waits for a later row.
+template <typename Chain>
+void checkChainCounts(const Chain &chain, int maxSize, const WideCount *row, int k, int i)
+{
+    if (chain.batcher.next < chain.batcher.switches.size() / 2)
+        return;
+    CGraph cg = chainEdgesCSR(chain.graph.nVertices, chain.edges);
+    std::vector<WideCount> counts(chainRowLength(maxSize));
+    countChainRow(&cg, maxSize, counts.data());
+    delCGraph(cg);
+    char tracked[41], recounted[41];
+    for (int p = 0; p < (int) counts.size(); p++)
+        if (counts[p] != row[p])
+        {
+            printf("chain %d, row %d: count %d is %s, but %s in a recount\n", k, i, p, formatWideCount(row[p], tracked), formatWideCount(counts[p], recounted));
+            exit(1);
+        }
+}
+
+// Makes the steps of chain for rows first to rows - 1, where counts holds row first - 1 (or the
+// counts of the input graph, for first 0), and calls visit(row) for every row, and between(i + 1)
+// after every row i but the last. Row 0 is the chain after burnIn steps, and every later row thin
+// steps after the one before: the steps in between update the counts but are not visited.
+template <typename Chain, typename Visit, typename Between>
+void walkChain(Chain &chain, std::vector<WideCount> &counts, int first, int rows, Count burnIn, int thin, Visit visit, Between between)
+{
+    for (int i = first; i < rows; i++)
+    {
+        for (Count s = 0, steps = i > 0 ? thin : burnIn; s < steps; s++)
+            chain.step(counts.data());
+        visit(counts.data());
+        if (i + 1 < rows)
+            between(i + 1);
+    }
+}
+
+// Whether something done every this many rows (never for 0) is due at row i.
+inline bool everyRows(int i, int every)
+{
+    return every > 0 && i % every == 0;
+}
+
+// The profiles of a chain: none without opt.profile, else one for every thread that makes its
+// switches (the switches of a batch are made by several threads, each timing its own).
+std::vector<ChainProfile> newChainProfiles(const ChainOptions &opt)
+{
+    if (opt.profile <= 0)
+        return std::vector<ChainProfile>();
+    return std::vector<ChainProfile>(opt.batch > 1 ? std::min(numThreads(), opt.batch) : 1, newChainProfile());
+}
+
+// The profile of thread tid, or NULL if the chain is not profiled.
+inline ChainProfile *threadProfile(std::vector<ChainProfile> &profiles, int tid)
+{
+    return profiles.empty() ? NULL : &profiles[tid];
+}
+
+// The profile of chain k: its output path with .profile.json appended.
+std::string chainProfilePath(int chain, int nChains)
+{
+    return chainOutputPath(chain, nChains) + ".profile.json";
+}
+
+// Writes the profile of chain (its threads together) to path, replacing the last one at once. The
+// time and the switches are those since start (of this run, for a resumed chain: the profiles are not
+// saved in the checkpoints). With last, also prints the switches per second.
+template <typename Chain>
+void writeChainProfile(const std::string &path, const Chain &chain, std::chrono::steady_clock::time_point start, bool last)
+{
+    if (chain.profiles.empty())
+        return;
+    ChainProfile total = newChainProfile();
+    for (const ChainProfile &p : chain.profiles)
+        mergeChainProfile(total, p);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "w");
+    if (!f)
+    {
+        printf("could not write the profile %s\n", path.c_str());
+        return;
+    }
+    writeChainProfileJson(f, total, seconds);
+    fclose(f);
+    rename(tmp.c_str(), path.c_str());
+    if (last)
+        printf("%s: %.0f switches per second\n", path.c_str(), seconds > 0 ? (total.steps - total.rejected) / seconds : 0.0);
+}
+
+// Statistics of the rows of a chain, accumulated as the rows are made, in O(patterns) memory however
+// long the chain is. For every pattern: the number of rows with a larger induced count than the input
+// graph (the upper tail of the serial test), and the mean and variance of the induced count (Welford),
+// for the z-score of the input graph. With a reservoir, also a uniform sample of that many rows
+// (algorithm R), for plots.
+struct ChainStatistics
+{
+    int maxSize;
+    std::vector<WideCount> original;    // induced counts of the input graph
+    std::vector<WideCount> induced;     // the induced counts of the current row
+    std::vector<Count> larger;
+    std::vector<double> mean, m2;       // m2 is the sum of squared deviations from the mean
+    Count rows;
+
+    int reservoirSize;
+    Rng reservoirRng;
+    std::vector<WideCount> reservoir;   // the sampled rows, as they are made (non-induced)
+    std::vector<Count> sampled;         // the row number of every sampled row
+};
+
+// Statistics against the counts of the input graph in initial (non-induced, of sizes 3 to maxSize).
+// The reservoir is sampled with stream (the chains themselves use streams 0, 1, ... of the seed).
+ChainStatistics newChainStatistics(const WideCount *initial, int maxSize, int reservoirSize, uint64_t seed, uint64_t stream)
+{
+    int rowLength = chainRowLength(maxSize);
+    ChainStatistics ret = {maxSize, std::vector<WideCount>(rowLength), std::vector<WideCount>(rowLength),
+                           std::vector<Count>(rowLength, 0), std::vector<double>(rowLength, 0), std::vector<double>(rowLength, 0), 0,
+                           reservoirSize, Rng(seed, stream), std::vector<WideCount>(), std::vector<Count>()};
+    inducedRow(initial, ret.original.data(), maxSize);
+    return ret;
+}
+
+void addChainRow(ChainStatistics &stats, const WideCount *row)
+{
+    int rowLength = stats.original.size();
+    inducedRow(row, stats.induced.data(), stats.maxSize);
+    stats.rows++;
+    for (int p = 0; p < rowLength; p++)
+    {
+        stats.larger[p] += stats.induced[p] > stats.original[p];
+        double x = (double) stats.induced[p];
+        double d = x - stats.mean[p];
+        stats.mean[p] += d / stats.rows;
+        stats.m2[p] += d * (x - stats.mean[p]);
+    }
+
+    if (stats.reservoirSize == 0)
+        return;
+    Count slot = stats.rows - 1;
+    if (slot >= stats.reservoirSize)
+    {
+        slot = stats.reservoirRng.below(stats.rows);
+        if (slot >= stats.reservoirSize)
+            return;
+    }
+    else
+    {
+        stats.reservoir.resize(stats.reservoir.size() + rowLength);
+        stats.sampled.push_back(0);
+    }
+    std::copy(row, row + rowLength, stats.reservoir.begin() + (size_t) slot * rowLength);
+    stats.sampled[slot] = stats.rows - 1;
+}
+
+// Adds the counts, means and variances of other (a chain from the same input graph) to stats
+// (the pairwise update of Chan et al.). The reservoir of other is dropped.
+void mergeChainStatistics(ChainStatistics &stats, const ChainStatistics &other)
+{
+    Count rows = stats.rows + other.rows;
+    if (rows == 0)
+        return;
+    for (size_t p = 0; p < stats.original.size(); p++)
+    {
+        double d = other.mean[p] - stats.mean[p];
+        stats.larger[p] += other.larger[p];
+        stats.mean[p] += d * other.rows / rows;
+        stats.m2[p] += other.m2[p] + d * d * ((double) stats.rows * other.rows / rows);
+    }
+    stats.rows = rows;
+}
+
+// Writes a line for every pattern: the pattern, its induced count in the input graph, the number of
+// larger rows, the mean and standard deviation of the induced count along the chain, and the z-score
+// of the input graph (0 when the count does not vary); with pValue, the p-value of the serial test,
+// (larger rows + 1) / steps, after the number of larger rows. A separator line follows every size.
+void writeChainStatistics(FILE *f, const ChainStatistics &stats, bool pValue, int steps)
+{
+    char buf[41];
+    for (int size = 3, offset = 0; size <= stats.maxSize; offset += chainBlockWidth[size - 3], size++)
+    {
+        for (int p = offset; p < offset + chainBlockWidth[size - 3]; p++)
+        {
+            double sd = stats.rows > 1 ? sqrt(stats.m2[p] / (stats.rows - 1)) : 0;
+            double z = sd > 0 ? ((double) stats.original[p] - stats.mean[p]) / sd : 0;
+            fprintf(f, "%d %s %lld ", p - offset, formatWideCount(stats.original[p], buf), (long long) stats.larger[p]);
+            if (pValue)
+                fprintf(f, "%.10g ", (stats.larger[p] + 1.0) / steps);
+            fprintf(f, "%.10g %.10g %.10g\n", stats.mean[p], sd, z);
+        }
+        fprintf(f, "-------------------------- \n");
+    }
+}
+
+// Writes the statistics of a chain (see writeChainStatistics), then the number of sampled rows, their row
+// numbers in increasing order on one line, and the rows themselves as in the trajectory output.
+void writeChainSample(FILE *f, const ChainStatistics &stats, bool induced)
+{
+    writeChainStatistics(f, stats, false, 0);
+
+    int rowLength = stats.original.size();
+    std::vector<int> order(stats.sampled.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return stats.sampled[a] < stats.sampled[b]; });
+    std::vector<WideCount> rows(stats.reservoir.size());
+    fprintf(f, "%d\n", (int) order.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        fprintf(f, "%lld ", (long long) stats.sampled[order[i]]);
+        std::copy(stats.reservoir.begin() + (size_t) order[i] * rowLength, stats.reservoir.begin() + (size_t) (order[i] + 1) * rowLength, rows.begin() + i * rowLength);
+    }
+    fprintf(f, "\n");
+    if (!order.empty())
+        writeChainRows(f, rows.data(), order.size(), stats.maxSize, induced);
+}
+
+// Checkpoints. A chain is saved as: the edge array (from which the chain graph is rebuilt), the
+// counts, the state of the random numbers, the batch of switches it is in the middle of, and the
+// statistics or the length of its output so far with the rows of the chunk it has not written yet
+// (so that the output is cut in the same chunks as without checkpoints). A checkpoint is binary, for the same build, and
+// belongs to one run: the mode, seed, chain, number of rows, burn-in, thinning and graph size are checked on resume.
+//
+// The state is copied when the checkpoint is taken, and a thread of its own writes the copy to a
+// temporary file and renames it over the checkpoint, so the chain goes on at once, and a checkpoint
+// on disk is always complete. The checkpoint of a chain is removed when the chain is done.
+
+enum ChainMode { chainRows, chainStats, chainSerialTest };
+
+struct ChainCheckpoint
+{
+    int mode, chain, rows;
+    uint64_t seed;
+    Count burnIn;
+    int thin;
+    VertexIdx nVertices;
+    int next;                           // the next row to make
+    std::vector<WideCount> counts;      // the counts of row next - 1
+    uint64_t rng[4];
+    ChainEdges edges;
+    std::vector<Edge> switches;         // the batch (see SwitchBatcher)
+    std::vector<WideCount> deltas;
+    uint64_t nextSwitch;
+    long outputBytes;                   // the length of the output, with the chunks written
+    std::vector<WideCount> pending;     // the rows after those, up to next - 1
+
+    // the statistics, if any
+    Count statRows;
+    std::vector<Count> larger;
+    std::vector<double> mean, m2;
+    uint64_t reservoirRng[4];
+    std::vector<WideCount> reservoir;
+    std::vector<Count> sampled;
+};
+
+// The burn-in of the chains in mode: none in the serial test, whose chains start at the input graph.
+Count chainBurnIn(const ChainOptions &opt, int mode)
+{
+    return mode == chainSerialTest ? 0 : opt.burnIn;
+}
+
+std::string chainCheckpointPath(int chain, int nChains)
+{
+    return chainOutputPath(chain, nChains) + ".ckpt";
+}
+
+template <typename T>
+void writeCheckpointVector(FILE *f, const std::vector<T> &v)
+{
+    uint64_t size = v.size();
+    fwrite(&size, sizeof(size), 1, f);
+    fwrite(v.data(), sizeof(T), size, f);
+}
+
+template <typename T>
+bool readCheckpointVector(FILE *f, std::vector<T> &v)
+{
+    uint64_t size;
+    if (fread(&size, sizeof(size), 1, f) != 1)
+        return false;
+    v.resize(size);
+    return fread(v.data(), sizeof(T), size, f) == size;
+}
+
+const char chainCheckpointMagic[8] = {'M', 'O', 'S', 'E', 'R', 'C', 'K', '3'};
+
+bool writeChainCheckpoint(const std::string &path, const ChainCheckpoint &c)
+{
+    std::string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f)
+        return false;
+    fwrite(chainCheckpointMagic, 1, 8, f);
+    int header[4] = {c.mode, c.chain, c.rows, c.next};
+    fwrite(header, sizeof(int), 4, f);
+    fwrite(&c.seed, sizeof(c.seed), 1, f);
+    fwrite(&c.burnIn, sizeof(c.burnIn), 1, f);
+    fwrite(&c.thin, sizeof(c.thin), 1, f);
+    fwrite(&c.nVertices, sizeof(c.nVertices), 1, f);
+    writeCheckpointVector(f, c.counts);
+    fwrite(c.rng, sizeof(uint64_t), 4, f);
+    writeCheckpointVector(f, c.edges.src);
+    writeCheckpointVector(f, c.edges.dst);
+    writeCheckpointVector(f, c.switches);
+    writeCheckpointVector(f, c.deltas);
+    fwrite(&c.nextSwitch, sizeof(c.nextSwitch), 1, f);
+    fwrite(&c.outputBytes, sizeof(c.outputBytes), 1, f);
+    writeCheckpointVector(f, c.pending);
+    fwrite(&c.statRows, sizeof(c.statRows), 1, f);
+    writeCheckpointVector(f, c.larger);
+    writeCheckpointVector(f, c.mean);
+    writeCheckpointVector(f, c.m2);
+    fwrite(c.reservoirRng, sizeof(uint64_t), 4, f);
+    writeCheckpointVector(f, c.reservoir);
+    writeCheckpointVector(f, c.sampled);
+    bool ok = !ferror(f);
+    ok = (fclose(f) == 0) && ok;
+    return ok && rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// Returns false if there is no checkpoint at path (or it is cut short).
+bool readChainCheckpoint(const std::string &path, ChainCheckpoint &c)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    char magic[8];
+    int header[4];
+    bool ok = fread(magic, 1, 8, f) == 8 && std::equal(magic, magic + 8, chainCheckpointMagic)
+           && fread(header, sizeof(int), 4, f) == 4
+           && fread(&c.seed, sizeof(c.seed), 1, f) == 1
+           && fread(&c.burnIn, sizeof(c.burnIn), 1, f) == 1
+           && fread(&c.thin, sizeof(c.thin), 1, f) == 1
+           && fread(&c.nVertices, sizeof(c.nVertices), 1, f) == 1
+           && readCheckpointVector(f, c.counts)
+           && fread(c.rng, sizeof(uint64_t), 4, f) == 4
+           && readCheckpointVector(f, c.edges.src)
+           && readCheckpointVector(f, c.edges.dst)
+           && readCheckpointVector(f, c.switches)
+           && readCheckpointVector(f, c.deltas)
+           && fread(&c.nextSwitch, sizeof(c.nextSwitch), 1, f) == 1
+           && fread(&c.outputBytes, sizeof(c.outputBytes), 1, f) == 1
+           && readCheckpointVector(f, c.pending)
+           && fread(&c.statRows, sizeof(c.statRows), 1, f) == 1
+           && readCheckpointVector(f, c.larger)
+           && readCheckpointVector(f, c.mean)
+           && readCheckpointVector(f, c.m2)
+           && fread(c.reservoirRng, sizeof(uint64_t), 4, f) == 4
+           && readCheckpointVector(f, c.reservoir)
+           && readCheckpointVector(f, c.sampled);
+    fclose(f);
+    c.mode = header[0];
+    c.chain = header[1];
+    c.rows = header[2];
+    c.next = header[3];
+    return ok;
+}
+
+// Exits because the file at path does not go with the checkpoint c.
+void exitFromAnotherRun(const std::string &path, const ChainCheckpoint &c)
+{
+    printf("%s is from another run (seed %llu, %d rows, burn-in %lld, thin %d): resume with the same arguments and --seed\n",
+           path.c_str(), (unsigned long long) c.seed, c.rows, (long long) c.burnIn, c.thin);
+    exit(1);
+}
+
+// With opt.resume, reads the checkpoints of the chains (next is 0 for a chain without one). Exits if
+// a checkpoint is from another run.
+std::vector<ChainCheckpoint> readChainCheckpoints(const ChainOptions &opt, int mode, const std::vector<int> &rows, VertexIdx nVertices, int rowLength)
+{
+    int nChains = rows.size();
+    std::vector<ChainCheckpoint> ret(nChains);
+    for (int k = 0; k < nChains; k++)
+    {
+        ret[k].next = 0;
+        std::string path = chainCheckpointPath(k, nChains);
+        if (!opt.resume || !readChainCheckpoint(path, ret[k]))
+        {
+            ret[k].next = 0;
+            continue;
+        }
+        if (ret[k].mode != mode || ret[k].chain != k || ret[k].rows != rows[k] || ret[k].seed != opt.seed
+            || ret[k].burnIn != chainBurnIn(opt, mode) || ret[k].thin != opt.thin || ret[k].nVertices != nVertices || (int) ret[k].counts.size() != rowLength)
+            exitFromAnotherRun(path, ret[k]);
+        printf("Resuming chain %d at row %d of %d\n", k, ret[k].next, rows[k]);
+    }
+    return ret;
+}
+
+// Copies the state of chain k (graph, edges, random numbers and batch, as in the chains of
+// ATAC3, ATAC4 and ATAC5) after row next - 1, with its counts, statistics (or NULL) and output length.
+template <typename Chain>
+std::shared_ptr<ChainCheckpoint> takeChainCheckpoint(const ChainOptions &opt, int mode, int k, int rows, int next, const Chain &chain,
+                                                     const std::vector<WideCount> &counts, const ChainStatistics *stats, long outputBytes)
+{
+    std::shared_ptr<ChainCheckpoint> c = std::make_shared<ChainCheckpoint>();
+    c->mode = mode;
+    c->chain = k;
+    c->rows = rows;
+    c->seed = opt.seed;
+    c->burnIn = chainBurnIn(opt, mode);
+    c->thin = opt.thin;
+    c->nVertices = chain.graph.nVertices;
+    c->next = next;
+    c->counts = counts;
+    chain.rng.getState(c->rng);
+    c->edges = chain.edges;
+    c->switches = chain.batcher.switches;
+    c->deltas = chain.batcher.deltas;
+    c->nextSwitch = chain.batcher.next;
+    c->outputBytes = outputBytes;
+    c->statRows = 0;
+    for (int j = 0; j < 4; j++)
+        c->reservoirRng[j] = 0;
+    if (stats)
+    {
+        c->statRows = stats->rows;
+        c->larger = stats->larger;
+        c->mean = stats->mean;
+        c->m2 = stats->m2;
+        stats->reservoirRng.getState(c->reservoirRng);
+        c->reservoir = stats->reservoir;
+        c->sampled = stats->sampled;
+    }
+    return c;
+}
+
+// Sets chain, counts and stats (or NULL) to the checkpoint c.
+template <typename Chain>
+void resumeChain(const ChainCheckpoint &c, Chain &chain, std::vector<WideCount> &counts, ChainStatistics *stats)
+{
+    counts = c.counts;
+    chain.rng.setState(c.rng);
+    chain.edges = c.edges;
+    chain.graph = newChainGraph(chain.graph.nVertices, chain.edges, chain.graph.trackTriangles);
+    chain.batcher.switches = c.switches;
+    chain.batcher.deltas = c.deltas;
+    chain.batcher.next = c.nextSwitch;
+    if (stats)
+    {
+        stats->rows = c.statRows;
+        stats->larger = c.larger;
+        stats->mean = c.mean;
+        stats->m2 = c.m2;
+        stats->reservoirRng.setState(c.reservoirRng);
+        stats->reservoir = c.reservoir;
+        stats->sampled = c.sampled;
+    }
+}
+
+// Writes the checkpoints of a chain in the background, one at a time.
+struct CheckpointWriter
+{
+    std::string path;
+    std::thread thread;
+};
+
+void saveChainCheckpoint(CheckpointWriter &w, std::shared_ptr<ChainCheckpoint> c)
+{
+    if (w.thread.joinable())
+        w.thread.join();
+    std::string path = w.path;
+    w.thread = std::thread([path, c]()
+    {
+        if (!writeChainCheckpoint(path, *c))
+            printf("could not write the checkpoint %s\n", path.c_str());
+    });
+}
+
+// Waits for the last checkpoint, and removes it (the chain is done).
+void finishChainCheckpoints(CheckpointWriter &w)
+{
+    if (w.thread.joinable())
+        w.thread.join();
+    remove(w.path.c_str());
+}
+
+// The header of the output of a chain of rows rows: the graph, the number of rows, and the number of
+// vertices and edges of cg.
+std::string chainOutputHeader(const ChainOptions &opt, int rows, const CGraph &cg)
+{
+    return std::string(opt.graph) + "\n" + std::to_string(rows) + "\n" + std::to_string((long long) cg.nVertices) + "\n"
+         + std::to_string((long long) cg.nEdges) + "\n";
+}
+
+// Cuts the output at path of a chain resumed from the checkpoint c back to the rows written before the
+// checkpoint. Exits if the output is not that of the checkpoint: another header, or shorter.
+void truncateResumedOutput(const std::string &path, const ChainCheckpoint &c, const std::string &header)
+{
+    struct stat st;
+    bool ok = stat(path.c_str(), &st) == 0 && st.st_size >= c.outputBytes && c.outputBytes >= (long) header.size();
+    if (ok)
+    {
+        std::string start(header.size(), '\0');
+        FILE *f = fopen(path.c_str(), "r");
+        ok = f && fread(&start[0], 1, start.size(), f) == start.size() && start == header;
+        if (f)
+            fclose(f);
+    }
+    if (!ok || truncate(path.c_str(), c.outputBytes) != 0)
+        exitFromAnotherRun(path, c);
+}
+
+// The serial test of MOSER. A chain of steps rows is cut at a uniform random pivot in [1, steps]
+// into two independent chains from the input graph, of pivot and steps - pivot rows (chains 0 and
+// 1, the pivot is drawn from stream 2 of the seed). The p-value of a pattern is one plus the number
+// of rows of both chains with a larger induced count than the input graph, divided by steps.
+//
+// The rows go into ChainStatistics as they are made, so nothing is stored. Writes out.txt: the header
+// of the chain outputs, the pivot, and the statistics of both chains together, with the p-values
+// (see writeChainStatistics).
+//
+// With opt.thin, the rows are opt.thin steps apart (the test holds for the chain of opt.thin steps at
+// a time, which is reversible as well). There is no burn-in: the test needs both chains to start at
+// the input graph.
+template <typename NewChain>
+void runSerialTest(const ChainOptions &opt, const CGraph &cg, int maxSize, const WideCount *initial, NewChain newChain)
+{
+    int steps = std::max(opt.steps[0], 1);
+    Rng pivotRng(opt.seed, 2);
+    int pivot = 1 + (int) pivotRng.below(steps);
+    int rows[2] = {pivot, steps - pivot};
+    printf("Serial test: pivot %d of %d steps\n", pivot, steps);
+    if (opt.burnIn > 0)
+        printf("The serial test starts both chains at the input graph: --burn-in is ignored\n");
+
+    int rowLength = chainRowLength(maxSize);
+    std::vector<ChainCheckpoint> saved = readChainCheckpoints(opt, chainSerialTest, std::vector<int>(rows, rows + 2), cg.nVertices, rowLength);
+    std::vector<ChainStatistics> stats;
+    for (int k = 0; k < 2; k++)
+        stats.push_back(newChainStatistics(initial, maxSize, 0, opt.seed, 0));
+    parallelRun(2, [&](int k)
+    {
+        auto chain = newChain(k);
+        std::vector<WideCount> counts(initial, initial + rowLength);
+        if (saved[k].next > 0)
+            resumeChain(saved[k], chain, counts, &stats[k]);
+        CheckpointWriter writer = {chainCheckpointPath(k, 2), std::thread()};
+        auto start = std::chrono::steady_clock::now();
+        walkChain(chain, counts, saved[k].next, rows[k], 0, opt.thin,
+                  [&](const WideCount *row) { addChainRow(stats[k], row); },
+                  [&](int next)
+                  {
+                      if (everyRows(next, opt.check))
+                          checkChainCounts(chain, maxSize, counts.data(), k, next - 1);
+                      if (everyRows(next, opt.checkpoint))
+                          saveChainCheckpoint(writer, takeChainCheckpoint(opt, chainSerialTest, k, rows[k], next, chain, counts, &stats[k], 0));
+                      if (everyRows(next, opt.profile))
+                          writeChainProfile(chainProfilePath(k, 2), chain, start, false);
+                  });
+        if (opt.check > 0)
+            checkChainCounts(chain, maxSize, counts.data(), k, rows[k] - 1);
+        finishChainCheckpoints(writer);
+        writeChainProfile(chainProfilePath(k, 2), chain, start, true);
+    });
+    mergeChainStatistics(stats[0], stats[1]);
+
+    FILE *f = fopen("out.txt", "w");
+    if (!f)
+    {
+        printf("could not write to output to out.txt\n");
+        return;
+    }
+    fputs(chainOutputHeader(opt, steps, cg).c_str(), f);
+    fprintf(f, "%d\n", pivot);
+    writeChainStatistics(f, stats[0], true, steps);
+    fclose(f);
+}
+
+// Runs one chain for every entry of opt.steps. newChain(k) returns chain k, whose step(row) makes one
+// switch and updates the counts in row. Every chain starts from the counts in initial (of sizes 3 to
+// maxSize), and writes its rows to chainOutputPath(k), after a header with the graph, the number of
+// rows, and the number of vertices and edges of cg. With opt.stats, the statistics of the rows (and
+// the reservoir of opt.reservoir rows, sampled with stream nChains + k) are written instead of the rows.
+// The rows are opt.thin steps apart, after opt.burnIn steps (see walkChain). With opt.checkpoint, the
+// chains are saved as they go, and with opt.resume they continue from there. With opt.profile, the
+// phases of the chains are timed (see writeChainProfile), and with opt.check, their counts are checked
+// against recounts (see checkChainCounts). With opt.serialTest, runs the serial test instead.
+template <typename NewChain>
+void runChains(const ChainOptions &opt, const CGraph &cg, int maxSize, const WideCount *initial, NewChain newChain)
+{
+    if (opt.serialTest)
+    {
+        runSerialTest(opt, cg, maxSize, initial, newChain);
+        return;
+    }
+
+    int nChains = opt.steps.size();
+    int rowLength = chainRowLength(maxSize);
+    int mode = opt.stats ? chainStats : chainRows;
+    std::vector<ChainCheckpoint> saved = readChainCheckpoints(opt, mode, opt.steps, cg.nVertices, rowLength);
+    // a resumed chain goes on with the rows it wrote before its checkpoint
+    for (int k = 0; k < nChains; k++)
+        if (saved[k].next > 0 && mode == chainRows)
+            truncateResumedOutput(chainOutputPath(k, nChains), saved[k], chainOutputHeader(opt, opt.steps[k], cg));
+    parallelRun(nChains, [&](int k)
+    {
+        std::string path = chainOutputPath(k, nChains);
+        bool append = saved[k].next > 0 && mode == chainRows;
+        FILE *f = fopen(path.c_str(), append ? "a" : "w");
+        if (!f)
+        {
+            printf("could not write to output to %s\n", path.c_str());
+            return;
+        }
+        if (!append)
+            fputs(chainOutputHeader(opt, opt.steps[k], cg).c_str(), f);
+
+        auto chain = newChain(k);
+        std::vector<WideCount> counts(initial, initial + rowLength);
+        ChainStatistics stats = newChainStatistics(initial, maxSize, opt.reservoir, opt.seed, nChains + k);
+        ChainStatistics *statsPtr = opt.stats ? &stats : NULL;
+        if (saved[k].next > 0)
+            resumeChain(saved[k], chain, counts, statsPtr);
+        CheckpointWriter writer = {chainCheckpointPath(k, nChains), std::thread()};
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<WideCount> rows(opt.stats ? 0 : (size_t) std::min(opt.steps[k], chainChunkRows) * rowLength);
+        int stored = 0, written = saved[k].next;
+        if (append)
+        {
+            stored = saved[k].pending.size() / rowLength;
+            written -= stored;
+            std::copy(saved[k].pending.begin(), saved[k].pending.end(), rows.begin());
+        }
+        auto writeRows = [&]()
+        {
+            writeChainRows(f, rows.data(), stored, maxSize, opt.induced);
+            written += stored;
+            stored = 0;
+        };
+        walkChain(chain, counts, saved[k].next, opt.steps[k], opt.burnIn, opt.thin, [&](const WideCount *row)
+        {
+            if (opt.stats)
+            {
+                addChainRow(stats, row);
+                return;
+            }
+            std::copy(row, row + rowLength, rows.begin() + (size_t) stored * rowLength);
+            stored++;
+            if (stored == chainChunkRows || written + stored == opt.steps[k])
+                writeRows();
+        },
+        [&](int next)
+        {
+            if (everyRows(next, opt.check))
+                checkChainCounts(chain, maxSize, counts.data(), k, next - 1);
+            if (everyRows(next, opt.checkpoint))
+            {
+                // the output on disk goes with the checkpoint, which keeps the rows not written yet
+                fflush(f);
+                std::shared_ptr<ChainCheckpoint> c = takeChainCheckpoint(opt, mode, k, opt.steps[k], next, chain, counts, statsPtr, ftell(f));
+                c->pending.assign(rows.begin(), rows.begin() + (size_t) stored * rowLength);
+                saveChainCheckpoint(writer, c);
+            }
+            if (everyRows(next, opt.profile))
+                writeChainProfile(chainProfilePath(k, nChains), chain, start, false);
+        });
+        if (opt.check > 0)
+            checkChainCounts(chain, maxSize, counts.data(), k, opt.steps[k] - 1);
+        finishChainCheckpoints(writer);
+        writeChainProfile(chainProfilePath(k, nChains), chain, start, true);
+
+        if (opt.stats)
+            writeChainSample(f, stats, opt.induced);
+        fclose(f);
+    });
+}
+
+#endif
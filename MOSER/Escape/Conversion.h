@@ -2,6 +2,8 @@
 #define ESCAPE_CONVERSION_H_
 
 #include <algorithm>
+#include <cmath>
+#include <cstddef>
 
 #include "Escape/FourVertex.h"
 #include "Escape/Utils.h"
@@ -21,7 +23,7 @@ const long ThreeIndToNonMatrix[4][4] = {
 // This matrix converts non-induced three pattern counts to induced three pattern counts
 
 const long ThreeNonToIndMatrix[4][4] = { 
-    {1, -1, -1, -1},
+    {1, -1, 1, -1},
     {0, 1, -2, 3},
     {0, 0, 1, -3},
     {0, 0, 0, 1}
@@ -59,6 +61,96 @@ const long FourNonToIndMatrix[11][11] = {
     {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1}
 };
 
+// This matrix converts induced 5-vertex pattern counts to non-induced 5-vertex pattern counts
+
+const long FiveIndToNonMatrix[34][34] = { 
+    { 1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1},
+    { 0,  1,  2,  2,  3,  3,  3,  4,  4,  5,  6,  3,  4,  4,  4,  4,  5,  5,  5,  5,  5,  6,  6,  6,  6,  6,  7,  7,  7,  7,  8,  8,  9, 10},
+    { 0,  0,  1,  0,  0,  0,  1,  1,  2,  2,  3,  2,  3,  0,  2,  3,  2,  4,  3,  4,  5,  5,  5,  4,  6,  6,  6,  6,  7,  8, 10,  9, 12, 15},
+    { 0,  0,  0,  1,  3,  3,  2,  5,  4,  8, 12,  1,  3,  6,  4,  3,  8,  6,  7,  6,  5, 10, 10, 11,  9,  9, 15, 15, 14, 13, 18, 19, 24, 30},
+    { 0,  0,  0,  0,  1,  0,  0,  1,  0,  2,  4,  0,  1,  0,  0,  0,  1,  1,  1,  0,  0,  2,  2,  2,  1,  0,  3,  4,  3,  2,  4,  5,  7, 10},
+    { 0,  0,  0,  0,  0,  1,  0,  1,  0,  2,  4,  0,  0,  4,  1,  0,  4,  1,  2,  1,  0,  4,  3,  5,  2,  2,  8,  7,  6,  4,  8, 10, 14, 20},
+    { 0,  0,  0,  0,  0,  0,  1,  2,  4,  6, 12,  0,  0,  0,  2,  2,  4,  4,  5,  6,  5,  8, 10, 10, 10, 12, 18, 18, 17, 18, 28, 28, 42, 60},
+    { 0,  0,  0,  0,  0,  0,  0,  1,  0,  4, 12,  0,  0,  0,  0,  0,  2,  1,  2,  0,  0,  4,  5,  6,  2,  0, 12, 15, 10,  6, 16, 22, 36, 60},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  3,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  1,  1,  1,  3,  3,  3,  2,  3,  5,  5,  9, 15},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  6,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  0,  0,  3,  6,  2,  1,  4,  8, 15, 30},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  1,  2,  5},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  3,  0,  1,  2,  1,  4,  2,  3,  5,  6,  5,  3,  7,  6,  6,  6,  9, 11, 16, 13, 21, 30},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  0,  1,  0,  0,  0,  2,  1,  0,  1,  0,  0,  1,  2,  2,  4,  3,  6, 10},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  1,  0,  0,  0,  0,  1,  0,  1,  0,  0,  2,  1,  1,  0,  1,  2,  3,  5},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  2,  1,  2,  2,  0,  4,  4,  5,  4,  6, 12,  9, 10, 10, 20, 20, 36, 60},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  2,  1,  2,  5,  4,  4,  2,  7,  6,  6,  6, 10, 14, 24, 18, 36, 60},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  0,  2,  0,  2,  0,  0,  6,  3,  3,  0,  4,  8, 15, 30},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  4,  2,  0,  2,  0,  0,  3,  6,  6, 16, 12, 30, 60},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  2,  2,  1,  0,  6,  6,  5,  4, 12, 14, 30, 60},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  1,  1,  2,  6,  6,  3,  4,  8, 16, 12, 30, 60},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  1,  0,  0,  0,  1,  2,  4,  2,  6, 12},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  0,  0,  0,  1,  0,  2,  2,  6, 15},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  0,  3,  2,  2,  8,  8, 24, 60},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  6,  3,  2,  0,  4, 10, 24, 60},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  2,  4, 12,  6, 24, 60},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  0,  0,  1,  2,  1,  4, 10},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  0,  1,  3, 10},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  2,  6, 20},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  4,  4, 18, 60},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  4,  1,  9, 30},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  3, 15},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  6, 30},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1, 10},
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1}
+};
+
+// This matrix converts non-induced 5-vertex pattern counts to induced 5-vertex pattern counts
+
+const long FiveNonToIndMatrix[34][34] = { 
+    {  1,  -1,   1,   1,  -1,  -1,  -1,   1,   1,  -1,   1,  -1,   1,   1,   1,   1,  -1,  -1,  -1,  -1,  -1,   1,   1,   1,   1,   1,  -1,  -1,  -1,  -1,   1,   1,  -1,   1},
+    {  0,   1,  -2,  -2,   3,   3,   3,  -4,  -4,   5,  -6,   3,  -4,  -4,  -4,  -4,   5,   5,   5,   5,   5,  -6,  -6,  -6,  -6,  -6,   7,   7,   7,   7,  -8,  -8,   9, -10},
+    {  0,   0,   1,   0,   0,   0,  -1,   1,   2,  -2,   3,  -2,   3,   0,   2,   3,  -2,  -4,  -3,  -4,  -5,   5,   5,   4,   6,   6,  -6,  -6,  -7,  -8,  10,   9, -12,  15},
+    {  0,   0,   0,   1,  -3,  -3,  -2,   5,   4,  -8,  12,  -1,   3,   6,   4,   3,  -8,  -6,  -7,  -6,  -5,  10,  10,  11,   9,   9, -15, -15, -14, -13,  18,  19, -24,  30},
+    {  0,   0,   0,   0,   1,   0,   0,  -1,   0,   2,  -4,   0,  -1,   0,   0,   0,   1,   1,   1,   0,   0,  -2,  -2,  -2,  -1,   0,   3,   4,   3,   2,  -4,  -5,   7, -10},
+    {  0,   0,   0,   0,   0,   1,   0,  -1,   0,   2,  -4,   0,   0,  -4,  -1,   0,   4,   1,   2,   1,   0,  -4,  -3,  -5,  -2,  -2,   8,   7,   6,   4,  -8, -10,  14, -20},
+    {  0,   0,   0,   0,   0,   0,   1,  -2,  -4,   6, -12,   0,   0,   0,  -2,  -2,   4,   4,   5,   6,   5,  -8, -10, -10, -10, -12,  18,  18,  17,  18, -28, -28,  42, -60},
+    {  0,   0,   0,   0,   0,   0,   0,   1,   0,  -4,  12,   0,   0,   0,   0,   0,  -2,  -1,  -2,   0,   0,   4,   5,   6,   2,   0, -12, -15, -10,  -6,  16,  22, -36,  60},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   1,  -1,   3,   0,   0,   0,   0,   0,   0,   0,   0,  -1,   0,   0,   1,   1,   1,   3,  -3,  -3,  -2,  -3,   5,   5,  -9,  15},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   1,  -6,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  -1,  -1,   0,   0,   3,   6,   2,   1,  -4,  -8,  15, -30},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  -1,   0,   0,   0,   1,  -2,   5},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,  -3,   0,  -1,  -2,   1,   4,   2,   3,   5,  -6,  -5,  -3,  -7,  -6,   6,   6,   9,  11, -16, -13,  21, -30},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,   0,   0,   0,  -1,   0,   0,   0,   2,   1,   0,   1,   0,   0,  -1,  -2,  -2,   4,   3,  -6,  10},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,   0,  -1,   0,   0,   0,   0,   1,   0,   1,   0,   0,  -2,  -1,  -1,   0,   1,   2,  -3,   5},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,  -2,  -1,  -2,  -2,   0,   4,   4,   5,   4,   6, -12,  -9, -10, -10,  20,  20, -36,  60},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,  -2,  -1,  -2,  -5,   4,   4,   2,   7,   6,  -6,  -6, -10, -14,  24,  18, -36,  60},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,   0,   0,   0,  -2,   0,  -2,   0,   0,   6,   3,   3,   0,  -4,  -8,  15, -30},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,   0,   0,  -4,  -2,   0,  -2,   0,   0,   3,   6,   6, -16, -12,  30, -60},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,   0,   0,  -2,  -2,  -1,   0,   6,   6,   5,   4, -12, -14,  30, -60},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,   0,  -1,  -1,  -2,  -6,   6,   3,   4,   8, -16, -12,  30, -60},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,   0,   0,  -1,   0,   0,   0,   1,   2,  -4,  -2,   6, -12},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,   0,   0,   0,   0,   0,  -1,   0,   2,   2,  -6,  15},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,   0,   0,   0,  -3,  -2,  -2,   8,   8, -24,  60},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,   0,  -6,  -3,  -2,   0,   4,  10, -24,  60},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,   0,   0,  -2,  -4,  12,   6, -24,  60},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,  -1,   0,   0,  -1,   2,   1,  -4,  10},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,   0,   0,   0,  -1,   3, -10},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,   0,   0,  -2,   6, -20},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,  -4,  -4,  18, -60},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,  -4,  -1,   9, -30},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,  -3,  15},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,  -6,  30},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1, -10},
+    {  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1}
+};
+
+// Connected 4-vertex patterns, by their degrees in increasing order (as decimal digits)
+const int FourPatternDegrees[6][2] = {
+    {5, 1113}, {6, 1122}, {7, 1223}, {8, 2222}, {9, 2233}, {10, 3333}
+};
+
+// Connected 5-vertex patterns, by their degrees in increasing order (as decimal digits) and their number of triangles
+const int FivePatternDegrees[21][3] = {
+    {13, 11114, 0}, {14, 11123, 0}, {15, 11222, 0}, {16, 11224, 1}, {17, 12223, 1}, {18, 11233, 1},
+    {19, 12223, 0}, {20, 22222, 0}, {21, 22224, 2}, {22, 12333, 2}, {23, 12234, 2}, {24, 22233, 1},
+    {25, 22233, 0}, {26, 22244, 3}, {27, 13334, 4}, {28, 22334, 3}, {29, 23333, 2}, {30, 33334, 4},
+    {31, 23344, 5}, {32, 33444, 7}, {33, 44444, 10}
+};
 
 
 
@@ -1094,7 +1186,83 @@ void closureMatrixFive(EdgeIdx (&nonind)[21], EdgeIdx (&ind)[21], double (&matri
             matrix[i][j] = ((double)conversion[i][j])*((double)ind[j])/((double)nonind[i]);
 
 }
-#endif
 
+// Exact conversion of whole trajectories of counts, as produced by the chain executables.
+//
+// Counts of patterns with isolated vertices grow like n^k/k!, which is past 2^53 (where
+// doubles stop being exact) already for moderate n, and the conversion subtracts large
+// counts from each other. So counts are kept as 128-bit integers, and every row is
+// multiplied with the integer matrix NonToInd of its size. This is exact as long as the
+// counts and their signed combinations fit in 127 bits (i.e. n below about 10^7 for
+// 5-vertex patterns, and far beyond that for 3 and 4 vertices).
+
+typedef __int128 WideCount;
+
+// Writes x in decimal to buf, which must have room for 41 characters. Returns buf.
+char *formatWideCount(WideCount x, char *buf)
+{
+    char digits[40];
+    int len = 0;
+    unsigned __int128 u = (x < 0) ? -(unsigned __int128) x : (unsigned __int128) x;
+    do
+    {
+        digits[len++] = '0' + (int) (u % 10);
+        u /= 10;
+    } while (u != 0);
+
+    char *pos = buf;
+    if (x < 0)
+        *pos++ = '-';
+    while (len > 0)
+        *pos++ = digits[--len];
+    *pos = '\0';
+    return buf;
+}
+
+// Converts rows of non-induced counts to induced counts. nonind and ind hold rows*K
+// counts, one row of K counts after the other, and may not overlap. The nonzero entries of the
+// matrix are collected once, so the whole batch costs one pass over the rows with
+// only the nonzero products (about a third of the entries for 5 vertices).
+template <int K>
+void convertTrajectory(const long (&nonToInd)[K][K], const WideCount *nonind, WideCount *ind, size_t rows)
+{
+    int row[K*K], col[K*K];
+    long coef[K*K];
+    int nnz = 0;
+    for (int i=0; i<K; i++)
+        for (int j=i; j<K; j++) // the matrices are upper triangular
+            if (nonToInd[i][j] != 0)
+            {
+                row[nnz] = i;
+                col[nnz] = j;
+                coef[nnz] = nonToInd[i][j];
+                nnz++;
+            }
+
+    for (size_t r=0; r<rows; r++)
+    {
+        const WideCount *in = nonind + r*K;
+        WideCount *out = ind + r*K;
+        for (int i=0; i<K; i++)
+            out[i] = 0;
+        for (int e=0; e<nnz; e++)
+            out[row[e]] += coef[e]*in[col[e]];
+    }
+}
+
+void convertThreeTrajectory(const WideCount (*nonind)[4], WideCount (*ind)[4], size_t rows)
+{
+    convertTrajectory(ThreeNonToIndMatrix, &nonind[0][0], &ind[0][0], rows);
+}
+
+void convertFourTrajectory(const WideCount (*nonind)[11], WideCount (*ind)[11], size_t rows)
+{
+    convertTrajectory(FourNonToIndMatrix, &nonind[0][0], &ind[0][0], rows);
+}
 
+void convertFiveTrajectory(const WideCount (*nonind)[34], WideCount (*ind)[34], size_t rows)
+{
+    convertTrajectory(FiveNonToIndMatrix, &nonind[0][0], &ind[0][0], rows);
+}
 
+#endif
@@ -2,126 +2,220 @@
 #define ESCAPE_FIVECYCLE_H_
 
 #include <algorithm>
+#include <vector>
 
 #include "Escape/ErrorCode.h"
 #include "Escape/Graph.h"
 #include "Escape/Digraph.h"
 #include "Escape/Triadic.h"
+#include "Escape/Parallel.h"
+#include "Escape/FourVertex.h"
 
 
 using namespace Escape;
 
+// Per-thread scratch for fiveCycleCounter.
+// Instead of looking up edges with binary searches, the neighbors of the current vertex i
+// and of the current in-neighbor j of i are marked. The marks are stamps (i+1, and the
+// position of j in gin plus 1), so they never need to be cleared.
+struct FiveCycleScratch
+{
+    WedgeScratch wedges;    // wedges from the current i, by their other end
+    VertexIdx *nbor_of_i;   // nbor_of_i[v] == i+1 iff v is a neighbor of i
+    EdgeIdx *nbor_of_j;     // nbor_of_j[v] == pos+1 iff v is a neighbor of j = gin->nbors[pos]
+};
+
+FiveCycleScratch newFiveCycleScratch(VertexIdx nVertices)
+{
+    FiveCycleScratch ret;
+    ret.wedges = newWedgeScratch(nVertices);
+    ret.nbor_of_i = new VertexIdx[nVertices+1];
+    ret.nbor_of_j = new EdgeIdx[nVertices+1];
+    for (VertexIdx v=0; v <= nVertices; v++)
+    {
+        ret.nbor_of_i[v] = 0;
+        ret.nbor_of_j[v] = 0;
+    }
+    return ret;
+}
+
+void delFiveCycleScratch(FiveCycleScratch &scratch)
+{
+    delWedgeScratch(scratch.wedges);
+    delete[] scratch.nbor_of_i;
+    delete[] scratch.nbor_of_j;
+}
+
+// Counts the wedges i - j - k whose center j is not the highest of the three vertices, by k,
+// and marks the neighbors of i.
+void addFiveCycleWedges(CGraph *gout, CGraph *gin, VertexIdx i, FiveCycleScratch &scratch)
+{
+    VertexIdx *wedge_count = scratch.wedges.wedge_count;
+    std::vector<VertexIdx> &touched = scratch.wedges.touched;
+
+    // loop over inout wedges ending at i
+    for (EdgeIdx pos = gin->offsets[i]; pos < gin->offsets[i+1]; ++pos) // loop over in-neighbors of i
+    {
+        VertexIdx j = gin->nbors[pos]; // j is current in-neighbor
+        scratch.nbor_of_i[j] = i+1;
+        for (EdgeIdx next = gin->offsets[j]; next < gin->offsets[j+1]; ++next) // loop over in-neighbors of j, note this gives an inout wedge
+        {
+            VertexIdx k = gin->nbors[next];  // i <- j <- k is wedge
+            if (wedge_count[k]++ == 0)
+                touched.push_back(k);
+        }
+
+        for (EdgeIdx next = gout->offsets[j]; next < gout->offsets[j+1]; ++next)
+        {
+            VertexIdx k = gout->nbors[next]; // i <- j -> k is wedge
+            if (k==i)
+                continue;
+            if (wedge_count[k]++ == 0)
+                touched.push_back(k);
+        }
+    }
+
+    // loop over inout wedges starting at i
+    for (EdgeIdx pos = gout->offsets[i]; pos < gout->offsets[i+1]; ++pos)
+    {
+        VertexIdx j = gout->nbors[pos];
+        scratch.nbor_of_i[j] = i+1;
+        for (EdgeIdx next = gout->offsets[j]; next < gout->offsets[j+1]; ++next)
+        {
+            VertexIdx k = gout->nbors[next]; // i -> j -> k is wedge
+            if (wedge_count[k]++ == 0)
+                touched.push_back(k);
+        }
+    }
+}
+
+// Every three path i <- j <- k -> ell, together with a wedge i - x - ell counted by addFiveCycleWedges,
+// closes a five-cycle, unless x is j (when j and ell are adjacent) or x is k (when i and k are adjacent).
+// This sums these five-cycles for the in-neighbors j of i in positions [begin, end) of gin.
+// wedge_count and nbor_of_i are those filled for i, and nbor_of_j is scratch.
+EdgeIdx fiveCyclePathsAt(CGraph *gout, CGraph *gin, VertexIdx i, EdgeIdx begin, EdgeIdx end, const VertexIdx *wedge_count, const VertexIdx *nbor_of_i, EdgeIdx *nbor_of_j)
+{
+    EdgeIdx ret = 0;
+    for (EdgeIdx pos = begin; pos < end; ++pos)
+    {
+        VertexIdx j = gin->nbors[pos];
+        if (gin->offsets[j+1] == gin->offsets[j]) // no three paths through j
+            continue;
+
+        // mark the neighbors of j
+        for (EdgeIdx next = gin->offsets[j]; next < gin->offsets[j+1]; ++next)
+            nbor_of_j[gin->nbors[next]] = pos+1;
+        for (EdgeIdx next = gout->offsets[j]; next < gout->offsets[j+1]; ++next)
+            nbor_of_j[gout->nbors[next]] = pos+1;
+
+        for (EdgeIdx next = gin->offsets[j]; next < gin->offsets[j+1]; ++next)
+        {
+            VertexIdx k = gin->nbors[next]; // i <- j <- k is wedge
+            EdgeIdx paths = 0, wedges = 0, chords = 0;
+            for (EdgeIdx next2 = gout->offsets[k]; next2 < gout->offsets[k+1]; ++next2)
+            {
+                VertexIdx ell = gout->nbors[next2]; // i <- j <- k -> ell is three path
+                if (ell == j || ell == i)
+                    continue;
+                ++paths;
+                wedges += wedge_count[ell];
+                chords += (nbor_of_j[ell] == pos+1); // wedge i - j - ell
+            }
+            ret += wedges - chords;
+            if (nbor_of_i[k] == i+1) // wedge i - k - ell, for every three path
+                ret -= paths;
+        }
+    }
+    return ret;
+}
+
+// Five-cycle counter
+// Input: The out-DAG and in-DAG of a degree ordered graph
+// Output: The number of 5-cycles
+//
+// At every vertex i, the wedges from i are counted by their other end, and every three path
+// i <- j <- k -> ell is closed into five-cycles with the wedges ending at ell. The paths through
+// j or k that do not give a cycle are subtracted using neighbor marks (see FiveCycleScratch).
+// The vertices are processed in parallel with per-thread scratch, scheduled by the number of
+// three paths and wedges they generate. For the few vertices with a large fraction of the work,
+// the wedges are counted on one thread and the three paths are split across all threads.
+
 EdgeIdx fiveCycleCounter(CGraph *gout, CGraph *gin)
 {
-   EdgeIdx ret=0;
-
-   VertexIdx i,j,k,ell;
-
-   VertexIdx *wedge_count = new VertexIdx[gin->nVertices+1];
-
-   int DEBUG = 0;
-
-   for (i=0; i < gin->nVertices; i++)
-       wedge_count[i] = 0;
-
-
-   for (i=0; i < gin->nVertices; ++i) // loop over vertices
-   {
-       if (DEBUG)
-           printf("----Handling %lld\n",i);
-
-       // loop over inout wedges ending at i
-       for (EdgeIdx pos = gin->offsets[i]; pos < gin->offsets[i+1]; ++pos) // loop over in-neighbors of i
-       {
-           j = gin->nbors[pos]; // j is current in-neighbor
-           for (EdgeIdx next = gin->offsets[j]; next < gin->offsets[j+1]; ++next) // loop over in-neighbors of j, note this gives an inout wedge
-           {
-               k = gin->nbors[next];  // i <- j <- k is wedge
-               wedge_count[k]++;
-           }
-
-           for (EdgeIdx next = gout->offsets[j]; next < gout->offsets[j+1]; ++next)
-           {
-               k = gout->nbors[next]; // i <- j -> k is wedge
-               if (k==i)
-                   continue;
-               wedge_count[k]++;
-           }
-       }
-
-       // loop over inout wedges starting at i
-       for (EdgeIdx pos = gout->offsets[i]; pos < gout->offsets[i+1]; ++pos)
-       {
-           j = gout->nbors[pos];
-           for (EdgeIdx next = gout->offsets[j]; next < gout->offsets[j+1]; ++next)
-           {
-               k = gout->nbors[next]; // i -> j -> k is wedge
-               wedge_count[k]++;
-           }
-       }
-
-
-       // generate three paths ending at i
-       for (EdgeIdx pos = gin->offsets[i]; pos < gin->offsets[i+1]; ++pos)
-       {
-           j = gin->nbors[pos];
-           for (EdgeIdx next = gin->offsets[j]; next < gin->offsets[j+1]; ++next)
-           {
-               k = gin->nbors[next]; // i <- j <- k is wedge
-               for (EdgeIdx next2 = gout->offsets[k]; next2 < gout->offsets[k+1]; ++next2)
-               {
-                   ell = gout->nbors[next2]; // i <- j <- k -> ell is three path
-                   if (ell == j || ell == i)
-                       continue;
-                   ret += wedge_count[ell];
-                   if (gout->getEdgeBinary(i,k) != -1 || gout->getEdgeBinary(k,i) != -1)
-                       ret--;
-                   if (gout->getEdgeBinary(j,ell) != -1 || gout->getEdgeBinary(ell,j) != -1)
-                       ret--;
-                   if (DEBUG)
-                   {
-                       printf("Three path: %lld <- %lld <- %lld -> %lld\n",i,j,k,ell);
-                       printf("Wedge count: %lld\n",wedge_count[ell]);
-                       if (gout->getEdgeBinary(i,k) != -1 || gout->getEdgeBinary(k,i) != -1)
-                           printf("Subtracted for i,k\n");
-                       if (gout->getEdgeBinary(j,ell) != -1 || gout->getEdgeBinary(ell,j) != -1)
-                           printf("Subtracted for j,ell\n");
-                   }
-               }
-           }
-       }
-
-       // clear wedge_count
-       // loop over inout wedges ending at i
-       for (EdgeIdx pos = gin->offsets[i]; pos < gin->offsets[i+1]; ++pos) // loop over in-neighbors of i
-       {
-           j = gin->nbors[pos]; // j is current in-neighbor
-           for (EdgeIdx next = gin->offsets[j]; next < gin->offsets[j+1]; ++next) // loop over in-neighbors of j, note this gives an inout wedge
-           {
-               k = gin->nbors[next];  // i <- j <- k is wedge
-               wedge_count[k] = 0;
-           }
-
-           for (EdgeIdx next = gout->offsets[j]; next < gout->offsets[j+1]; ++next)
-           {
-               k = gout->nbors[next];
-               wedge_count[k] = 0;
-           }
-       }
-
-       // loop over inout wedges starting at i
-       for (EdgeIdx pos = gout->offsets[i]; pos < gout->offsets[i+1]; ++pos)
-       {
-           j = gout->nbors[pos];
-           for (EdgeIdx next = gout->offsets[j]; next < gout->offsets[j+1]; ++next)
-           {
-               k = gout->nbors[next]; // i -> j -> k is wedge
-               wedge_count[k] = 0;
-           }
-       }
-   }
-
-   return ret;
+    EdgeIdx ret = 0;
+    int nthreads = numThreads();
+
+    // path_work[j] is the number of three paths j <- k -> ell, over in-neighbors k of j
+    EdgeIdx *path_work = new EdgeIdx[gin->nVertices+1];
+    for (VertexIdx j=0; j < gin->nVertices; ++j)
+    {
+        path_work[j] = 0;
+        for (EdgeIdx next = gin->offsets[j]; next < gin->offsets[j+1]; ++next)
+        {
+            VertexIdx k = gin->nbors[next];
+            path_work[j] += gout->offsets[k+1] - gout->offsets[k];
+        }
+    }
+
+    // work[i] is the number of three paths and wedges generated from i
+    EdgeIdx *work = new EdgeIdx[gin->nVertices+1];
+    for (VertexIdx i=0; i < gin->nVertices; ++i)
+    {
+        work[i] = 0;
+        for (EdgeIdx pos = gin->offsets[i]; pos < gin->offsets[i+1]; ++pos)
+        {
+            VertexIdx j = gin->nbors[pos];
+            work[i] += path_work[j] + (gin->offsets[j+1] - gin->offsets[j]) + (gout->offsets[j+1] - gout->offsets[j]);
+        }
+        for (EdgeIdx pos = gout->offsets[i]; pos < gout->offsets[i+1]; ++pos)
+        {
+            VertexIdx j = gout->nbors[pos];
+            work[i] += gout->offsets[j+1] - gout->offsets[j];
+        }
+    }
+
+    std::vector<VertexIdx> heavy = heavyVertices(gin->nVertices, work, nthreads);
+    for (VertexIdx i : heavy)
+        work[i] = -1; // marks i as heavy, so that the vertex loop skips it
+
+    std::vector<FiveCycleScratch> scratch(nthreads);
+    std::vector<PaddedCount> partial(nthreads, PaddedCount{0, {}});
+    for (int t=0; t < nthreads; t++)
+        scratch[t] = newFiveCycleScratch(gin->nVertices);
+
+    parallelForWeighted(gin->nVertices, work, nthreads, [&](int tid, VertexIdx i)
+    {
+        if (work[i] < 0) // heavy vertex, handled below
+            return;
+        FiveCycleScratch &s = scratch[tid];
+        addFiveCycleWedges(gout, gin, i, s);
+        partial[tid].value += fiveCyclePathsAt(gout, gin, i, gin->offsets[i], gin->offsets[i+1], s.wedges.wedge_count, s.nbor_of_i, s.nbor_of_j);
+        for (VertexIdx k : s.wedges.touched) // clear wedge_count
+            s.wedges.wedge_count[k] = 0;
+        s.wedges.touched.clear();
+    });
+
+    for (VertexIdx i : heavy)
+    {
+        FiveCycleScratch &s = scratch[0];
+        addFiveCycleWedges(gout, gin, i, s);
+        parallelFor(gin->offsets[i], gin->offsets[i+1], 16, nthreads, [&](int tid, EdgeIdx pos)
+        {
+            partial[tid].value += fiveCyclePathsAt(gout, gin, i, pos, pos+1, s.wedges.wedge_count, s.nbor_of_i, scratch[tid].nbor_of_j);
+        });
+        for (VertexIdx k : s.wedges.touched)
+            s.wedges.wedge_count[k] = 0;
+        s.wedges.touched.clear();
+    }
+
+    for (int t=0; t < nthreads; t++)
+    {
+        ret += partial[t].value;
+        delFiveCycleScratch(scratch[t]);
+    }
+    delete[] path_work;
+    delete[] work;
+    return ret;
 }
 
 /*
@@ -2,11 +2,14 @@
 #define ESCAPE_FIVEFROMCYCLECLIQUE_H_
 
 #include <algorithm>
+#include <vector>
 
 #include "Escape/ErrorCode.h"
 #include "Escape/Graph.h"
 #include "Escape/Digraph.h"
 #include "Escape/Triadic.h"
+#include "Escape/Parallel.h"
+#include "Escape/OutNeighborhood.h"
 
 
 using namespace Escape;
@@ -50,7 +53,7 @@ CycleBased initfourCycleBasedCounter(CGraph *gout, CGraph *gin, TriangleInfo *ou
    int DEBUG = 0;
 
    //EdgeIdx numType1FourCycle, numType2FourCycle, numType3FourCycle;
-   double type1tailed = 0, type2tailed = 0;
+   EdgeIdx type1tailed2 = 0, type2tailed2 = 0; // twice the type1 and type2 tailed counts, whose terms have halves
    EdgeIdx type1hatted = 0, type2hatted = 0, type3hatted = 0;
    EdgeIdx type3tailed = 0;
 
@@ -107,7 +110,7 @@ CycleBased initfourCycleBasedCounter(CGraph *gout, CGraph *gin, TriangleInfo *ou
                type3hatted += inout_count[k]*total_tri;
 
                if (k < i)
-                    type1tailed += ((double)(degk-2)/2 + (double)(degi-2)/2 + (double)(degj-2))*(outout_count[k]-1);
+                    type1tailed2 += ((degk-2) + (degi-2) + 2*(degj-2))*(outout_count[k]-1);
 
                type3tailed += (degk-2 + degi-2 + degj-2)*inout_count[k];
 
@@ -117,7 +120,7 @@ if(DEBUG)
                printf("Info: outout_count[%lld] = %lld, inout_count[%lld] = %lld, total_tri = %lld\n",k,outout_count[k],k,inout_count[k],total_tri);
                printf("Degs: degi = %lld, degj = %lld, degk = %lld\n",degi,degj,degk);
                printf("Adding %lld to type1hatted, %lld to type3hatted\n",(outout_count[k]-1)*total_tri,inout_count[k]*total_tri);
-               printf("Adding %lf to type1tailed, %lld to type3tailed\n\n",((double)(degk-2)/2 + (double)(degi-2)/2 + (double)(degj-2))*(outout_count[k]-1),(degk-2 + degi-2 + degj-2)*inout_count[k]);
+               printf("Adding %lld/2 to type1tailed, %lld to type3tailed\n\n",((degk-2) + (degi-2) + 2*(degj-2))*(outout_count[k]-1),(degk-2 + degi-2 + degj-2)*inout_count[k]);
 }
             }
 /*               to_add = (outout_count[k] - 1)*(degj - 2)/2 + inout_count[k]*(degj-2); // (i,j,k) form a type1 4-cycle with every other outout wedge. An edge incident to j gives the tail. This pattern is touched twice, so we divide by 2
@@ -151,7 +154,7 @@ if(DEBUG)
                
                type3hatted += outout_count[k]*total_tri;
                
-               type2tailed += ((double)(degk-2)/2 + (double)(degi-2)/2 + degj-2)*(inout_count[k]-1);
+               type2tailed2 += ((degk-2) + (degi-2) + 2*(degj-2))*(inout_count[k]-1);
 
                type3tailed += (degj-2)*outout_count[k];
 if(DEBUG)
@@ -160,7 +163,7 @@ if(DEBUG)
                printf("Info: outout_count[%lld] = %lld, inout_count[%lld] = %lld, total_tri = %lld\n",k,outout_count[k],k,inout_count[k],total_tri);
                printf("Degs: degi = %lld, degj = %lld, degk = %lld\n",degi,degj,degk);
                printf("Adding %lld to type2hatted, %lld to type3hatted\n",(inout_count[k]-1)*total_tri,outout_count[k]*total_tri);
-               printf("Adding %lf to type2tailed, %lld to type3tailed\n\n",((double)(degk-2)/2 + (double)(degi-2)/2 + degj-2)*(inout_count[k]-1),(degj-2)*outout_count[k]);
+               printf("Adding %lld/2 to type2tailed, %lld to type3tailed\n\n",((degk-2) + (degi-2) + 2*(degj-2))*(inout_count[k]-1),(degj-2)*outout_count[k]);
 }
            } 
        }
@@ -185,8 +188,8 @@ if(DEBUG)
 //    printf("type1hatted = %lld, type2hatted = %lld, type3hatted = %lld\n",(long)type1hatted, (long)type2hatted, (long)type3hatted);
 //    printf("type1tailed = %lld, type2tailed = %lld, type3tailed = %lld\n",(long)type1tailed, (long)type2tailed, (long)type3tailed);
 
-   ret.tailedfourcycles = (long)(type1tailed + type2tailed + type3tailed + 0.5);
-   ret.hattedfourcycles = (long)(type1hatted/2 + type2hatted + type3hatted + 0.5);
+   ret.tailedfourcycles = (type1tailed2 + type2tailed2)/2 + type3tailed;
+   ret.hattedfourcycles = type1hatted/2 + type2hatted + type3hatted;
    return ret;
 }
 
@@ -201,6 +204,17 @@ CycleBased fourCycleBasedCounter(CGraph *gout, CGraph *gin, TriangleInfo *outinf
 
 }
 
+// 4-clique based counter
+// Input: A graph g, its degree ordered out-DAG gout sorted by ID, and the TriangleInfo of gout
+// Output: The number of tailed 4-cliques, hatted 4-cliques (before corrections) and 5-cliques
+//
+// Every 4-clique (i,j,k,ell) is found at its lowest vertex i, as a triangle of the out-neighborhood
+// of i (see fourCliqueCounter). At every 4-clique, the degrees of its vertices give the tailed
+// 4-cliques, and the triangle counts of its edges give the hatted 4-cliques. The 5-cliques with
+// lowest vertex i are the 4-cliques of the out-neighborhood, so every 4-clique (i,j,k,ell) with
+// j < k < ell adds the number of common out-neighbors of j, k and ell (a three-row AND of the
+// neighborhood bitmap). Vertices are processed in parallel, each thread with its own neighborhood.
+
 CliqueBased fourCliqueBasedCounter(CGraph *g, CGraph *gout, TriangleInfo *info)
 {
     CliqueBased ret; // return value
@@ -209,93 +223,62 @@ CliqueBased fourCliqueBasedCounter(CGraph *g, CGraph *gout, TriangleInfo *info)
     ret.hattedfourcliques = 0;
     ret.fivecliques = 0;
 
-    bool to_print = false;
-   
-    int DEBUG = 0; 
-    VertexIdx *dummy = new VertexIdx[5];
-    VertexIdx *triends = new VertexIdx[gout->nVertices+1]; // array to store triangle ends
-    VertexIdx *k4ends = new VertexIdx[gout->nVertices+1]; // array to store 4-clique ends
-    EdgeIdx *ind_from_i = new VertexIdx[gout->nVertices+1]; // array to store indices into nbors
-    EdgeIdx *ind_from_j = new VertexIdx[gout->nVertices+1]; // array to store indices into nbors
-
-    for (VertexIdx i=0; i < gout->nVertices; ++i) // loop over vertices
-        for (VertexIdx posj = gout->offsets[i]; posj < gout->offsets[i+1]; ++posj) // loop over out-neighbors of i
+    int nthreads = numThreads();
+
+    EdgeIdx *work = new EdgeIdx[gout->nVertices+1]; // work[i] is the number of edges scanned to load out-neighborhood of i
+    for (VertexIdx i=0; i < gout->nVertices; ++i)
+    {
+        work[i] = 0;
+        for (EdgeIdx posj = gout->offsets[i]; posj < gout->offsets[i+1]; ++posj)
+        {
+            VertexIdx j = gout->nbors[posj];
+            work[i] += gout->offsets[j+1] - gout->offsets[j];
+        }
+    }
+
+    std::vector<OutNeighborhood> nbs(nthreads);
+    std::vector<PaddedCount> tailed(nthreads, PaddedCount{0, {}});
+    std::vector<PaddedCount> hatted(nthreads, PaddedCount{0, {}});
+    std::vector<PaddedCount> fives(nthreads, PaddedCount{0, {}});
+    for (int t=0; t < nthreads; t++)
+        nbs[t] = newOutNeighborhood(gout);
+
+    parallelForWeighted(gout->nVertices, work, nthreads, [&](int tid, VertexIdx i)
+    {
+        if (gout->offsets[i+1] - gout->offsets[i] < 3) // no 4-clique has i as lowest vertex
+            return;
+        OutNeighborhood &nb = nbs[tid];
+        loadOutNeighborhood(gout, i, nb);
+
+        VertexIdx degi = g->offsets[i+1] - g->offsets[i];
+        for (VertexIdx j=0; j < nb.size; ++j) // loop over triangles (i,j,k)
         {
-            VertexIdx j = gout->nbors[posj]; // j is current out-neighbor
-            VertexIdx count = 0;
-            for (VertexIdx posk = posj+1; posk < gout->offsets[i+1]; ++posk) // loop over another out-neighbor of i, that is "ahead" of j in list of out-neighbors
+            VertexIdx degj = g->offsets[nb.vertices[j]+1] - g->offsets[nb.vertices[j]];
+            for (EdgeIdx posk = nb.offsets[j]; posk < nb.offsets[j+1]; ++posk)
             {
-                VertexIdx k = gout->nbors[posk]; // k is next out-neighbor
-                EdgeIdx edge_ind_jk = gout->getEdgeBinary(j,k);// check if edge (j,k) is present
-                if (edge_ind_jk != -1) // edge (j,k) is present
-                {
-                    triends[count] = k;  // so (i,j,k) form a triangle. we store the fact that k forms a triangle with edge (i,j) in digraph gout
-                    ind_from_i[count] = posk;
-                    ind_from_j[count] = edge_ind_jk;
-                    ++count;
-                }
-            }
+                VertexIdx k = nb.nbors[posk];
+                VertexIdx degk = g->offsets[nb.vertices[k]+1] - g->offsets[nb.vertices[k]];
+                Count tri_ijk = info->perEdge[nb.firstEdge+j] + info->perEdge[nb.firstEdge+k] + info->perEdge[nb.edges[posk]];
 
-            for (VertexIdx posk = 0; posk < count; ++posk) // loop over all of triangles with edge (i,j)
-            {
-                VertexIdx count2 = 0;
-                VertexIdx k = triends[posk]; // (i,j,k) is triangle
-                for (VertexIdx posell = posk+1; posell < count; ++posell) // loop over another triangle with edge (i,j)
+                forEachLocalCommon(nb, j, k, [&](VertexIdx ell, EdgeIdx posjell, EdgeIdx poskell) // (i,j,k,ell) is 4-clique
                 {
-                    VertexIdx ell = triends[posell]; // (i,j,ell) is next triangle
-                    EdgeIdx edge_ind_kell = gout->getEdgeBinary(k,ell);
-                    if (edge_ind_kell != -1) // (k,ell) is an end, thus (i,j,k,ell) form a 4-clique
-                    {
-                        k4ends[count2] = ell; // ell forms 4-clique with (i,j,k), so this is stored in k4ends
-                        ++count2;
-
-                        VertexIdx degi = g->offsets[i+1] - g->offsets[i];
-                        VertexIdx degj = g->offsets[j+1] - g->offsets[j];
-                        VertexIdx degk = g->offsets[k+1] - g->offsets[k];
-                        VertexIdx degell = g->offsets[ell+1] - g->offsets[ell];
-
-                        VertexIdx total_edge = degi + degj + degk + degell - 12;
-
-                        VertexIdx tri_ij = info->perEdge[posj];
-                        VertexIdx tri_ik = info->perEdge[ind_from_i[posk]];
-                        VertexIdx tri_iell = info->perEdge[ind_from_i[posell]];
-                        VertexIdx tri_jk = info->perEdge[ind_from_j[posk]];
-                        VertexIdx tri_jell = info->perEdge[ind_from_j[posell]];
-                        VertexIdx tri_kell = info->perEdge[edge_ind_kell];
-
-                        VertexIdx total_tri = tri_ij + tri_ik + tri_iell + tri_jk + tri_jell + tri_kell - 12;
-
-                        ret.tailedfourcliques += total_edge;
-                        ret.hattedfourcliques += total_tri;
-                    }
-                }
-
-                for (VertexIdx posell = 0; posell < count2; ++posell) // loop over all pairs of 4-cliques with triangle (i,j,k)
-                    for (VertexIdx posoh = posell+1; posoh < count2; ++posoh)
-                    {
-                        VertexIdx ell = k4ends[posell]; // ell and oh are the vertices
-                        VertexIdx oh = k4ends[posoh];
-//                         if (DEBUG)
-//                             printf("%lld %lld %lld: checking %lld %lld\n",i,j,k,ell,oh);
-                        if (gout->isEdge(ell,oh) != -1) // (ell,oh) is edge, so (i,j,k,ell,oh) form 5-clique
-                        {
-                            ret.fivecliques++;
-                            if (DEBUG)
-                            {
-                                dummy[0] = i;
-                                dummy[1] = j;
-                                dummy[2] = k;
-                                dummy[3] = ell;
-                                dummy[4] = oh;
-                                std::sort(dummy,dummy+5);
-                                printf("%lld %lld %lld %lld %lld\n",dummy[0],dummy[1],dummy[2],dummy[3],dummy[4]);
-                            }
-                            if(ret.fivecliques%100000000 == 0 && to_print)
-                                printf("Found another 100M 5-cliques\n");
-                        }
-                    }
+                    VertexIdx degell = g->offsets[nb.vertices[ell]+1] - g->offsets[nb.vertices[ell]];
+                    tailed[tid].value += degi + degj + degk + degell - 12;
+                    hatted[tid].value += tri_ijk + info->perEdge[nb.firstEdge+ell] + info->perEdge[nb.edges[posjell]] + info->perEdge[nb.edges[poskell]] - 12;
+                    fives[tid].value += countLocalCommon(nb, j, k, ell); // every common out-neighbor of j, k, ell gives a 5-clique
+                });
             }
         }
+    });
+
+    for (int t=0; t < nthreads; t++)
+    {
+        ret.tailedfourcliques += tailed[t].value;
+        ret.hattedfourcliques += hatted[t].value;
+        ret.fivecliques += fives[t].value;
+        delOutNeighborhood(nbs[t]);
+    }
+    delete[] work;
     return ret;
 }
 
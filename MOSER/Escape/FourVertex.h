@@ -2,12 +2,15 @@
 #define ESCAPE_FOURVERTEX_H_
 
 #include <algorithm>
+#include <vector>
 
 #include "Escape/ErrorCode.h"
 #include "Escape/Graph.h"
 #include "Escape/Digraph.h"
 #include "Escape/Triadic.h"
 #include "Escape/Utils.h"
+#include "Escape/Parallel.h"
+#include "Escape/OutNeighborhood.h"
 
 using namespace Escape;
 
@@ -52,9 +55,10 @@ struct SomeFourPatterns
 // #tailed-triangles = \sum_v (d_v-2)t_v
 // #chordal-cycles = \sum_e {t_e \choose 2}
 //
-// 
+// The triangle counts are taken from info, which must be the TriangleInfo of gout
+// (from betterWedgeEnumerator, getAllThree, or fourVertexCounter).
 
-SomeFourPatterns easyFourCounter(CGraph *g, CGraph *gout)
+SomeFourPatterns easyFourCounter(CGraph *g, CGraph *gout, const TriangleInfo &info)
 {
     SomeFourPatterns ret;
     ret.threestars = 0;
@@ -63,9 +67,6 @@ SomeFourPatterns easyFourCounter(CGraph *g, CGraph *gout)
     ret.tailedtris = 0;
     EdgeIdx degi=0, degj=0;
 
-    TriangleInfo info;
-    info = betterWedgeEnumerator(gout);
-    
     for (VertexIdx i=0; i < g->nVertices; i++)
     {
         degi = g->offsets[i+1]-g->offsets[i];
@@ -90,6 +91,16 @@ SomeFourPatterns easyFourCounter(CGraph *g, CGraph *gout)
     return ret;
 }
 
+// Same, but enumerates the triangles first
+
+SomeFourPatterns easyFourCounter(CGraph *g, CGraph *gout)
+{
+    TriangleInfo info = betterWedgeEnumerator(gout);
+    SomeFourPatterns ret = easyFourCounter(g, gout, info);
+    delTriangleInfo(info);
+    return ret;
+}
+
 
 // Old version uses old wedge enumerator
 // 
@@ -130,54 +141,244 @@ SomeFourPatterns oldeasyFourCounter(CGraph *g, CGraph *gout)
     return ret;
 }
 
-EdgeIdx fourCycleCounter(CGraph *gout, CGraph *gin)
+// Per-thread scratch for counting wedges that end at a vertex.
+// wedge_count[k] is the number of wedges (from the current vertex) ending at k,
+// and touched lists every k with a non-zero count, so that the counts can be
+// consumed and reset without walking the wedges a second time.
+struct WedgeScratch
+{
+    VertexIdx *wedge_count;
+    std::vector<VertexIdx> touched;
+};
+
+WedgeScratch newWedgeScratch(VertexIdx nVertices)
+{
+    WedgeScratch ret;
+    ret.wedge_count = new VertexIdx[nVertices+1];
+    for (VertexIdx i=0; i <= nVertices; i++) // initialize all wedge_count values to 0
+        ret.wedge_count[i] = 0;
+    return ret;
+}
+
+void delWedgeScratch(WedgeScratch &scratch)
+{
+    delete[] scratch.wedge_count;
+}
+
+// Adds the outout and inout wedges i <- j -> k and i <- j <- k (k < i for outout) to scratch.
+// These are the wedges of fourCycleCounter, for in-neighbors j of i in positions [begin, end) of gin.
+void addFourCycleWedges(CGraph *gout, CGraph *gin, VertexIdx i, EdgeIdx begin, EdgeIdx end, WedgeScratch &scratch)
+{
+    for (EdgeIdx pos = begin; pos < end; ++pos) // loop over in-neighbors of i
+    {
+        VertexIdx j = gin->nbors[pos]; // j is current in-neighbor
+        for (EdgeIdx next = gout->offsets[j]; next < gout -> offsets[j+1]; ++next) // loop over out-neighbors of j, note this gives an outout wedge
+        {
+            VertexIdx k = gout->nbors[next];  // i <- j -> k is outout wedge centered at j
+            if (k>=i)   // break ties to prevent overcount
+                continue;
+            if (scratch.wedge_count[k]++ == 0) // increment number of wedges ending at k
+                scratch.touched.push_back(k);
+        }
+        for (EdgeIdx next = gin->offsets[j]; next < gin->offsets[j+1]; ++next) // loop over in-neighbors of j, note this gives inout wedge
+        {
+            VertexIdx k = gin->nbors[next]; // i <- j <- k is inout wedge centered at j
+            if (scratch.wedge_count[k]++ == 0) // increment number of wedges ending at k
+                scratch.touched.push_back(k);
+        }
+    }
+}
+
+// Every pair of wedges ending at the same k yields a four-cycle. Also resets scratch.
+// If perVertex is not NULL, the four-cycles are also added to both ends i and k of the wedges.
+EdgeIdx collectFourCycles(WedgeScratch &scratch, VertexIdx i, Count *perVertex)
+{
+    EdgeIdx ret = 0;
+    for (VertexIdx k : scratch.touched)
+    {
+        EdgeIdx cycles = (scratch.wedge_count[k]*(scratch.wedge_count[k]-1))/2;
+        ret += cycles;
+        if (perVertex)
+            atomicAdd(perVertex+k, cycles);
+        scratch.wedge_count[k] = 0; //reset value of wedge_count
+    }
+    if (perVertex)
+        atomicAdd(perVertex+i, ret);
+    scratch.touched.clear();
+    return ret;
+}
+
+// For local counts: a wedge from i ending at k forms a four-cycle with each of the other wedge_count[k]-1
+// wedges ending at k. This is added to the center j of the wedge and to both edges of the wedge,
+// for the wedges of in-neighbors j of i in positions [begin, end) of gin.
+// inToOut maps positions in gin->nbors to the position of the same edge in gout->nbors.
+void addFourCyclesToWedges(CGraph *gout, CGraph *gin, const EdgeIdx *inToOut, VertexIdx i, EdgeIdx begin, EdgeIdx end, const VertexIdx *wedge_count, Count *perVertex, Count *perEdge)
+{
+    for (EdgeIdx pos = begin; pos < end; ++pos) // loop over in-neighbors of i
+    {
+        VertexIdx j = gin->nbors[pos];
+        Count at_j = 0; // four-cycles through edge (j,i), and so through j
+        for (EdgeIdx next = gout->offsets[j]; next < gout -> offsets[j+1]; ++next) // outout wedges i <- j -> k
+        {
+            VertexIdx k = gout->nbors[next];
+            if (k>=i)
+                continue;
+            at_j += wedge_count[k]-1;
+            atomicAdd(perEdge+next, wedge_count[k]-1);
+        }
+        for (EdgeIdx next = gin->offsets[j]; next < gin->offsets[j+1]; ++next) // inout wedges i <- j <- k
+        {
+            VertexIdx k = gin->nbors[next];
+            at_j += wedge_count[k]-1;
+            atomicAdd(perEdge+inToOut[next], wedge_count[k]-1);
+        }
+        atomicAdd(perVertex+j, at_j);
+        atomicAdd(perEdge+inToOut[pos], at_j);
+    }
+}
+
+// Returns an array that maps every position in gin->nbors to the position of the same edge in gout->nbors.
+// Requires gin to be the reverse of gout, and sorted by ID.
+EdgeIdx *inToOutPositions(CGraph *gout, CGraph *gin)
+{
+    EdgeIdx *ret = new EdgeIdx[gin->nEdges+1];
+    EdgeIdx *cursor = new EdgeIdx[gin->nVertices+1]; // next free position in the in-list of each vertex
+    for (VertexIdx i=0; i < gin->nVertices; ++i)
+        cursor[i] = gin->offsets[i];
+
+    // the in-neighbors of i are sorted, so visiting edges (j,i) in increasing order of j fills them in order
+    for (VertexIdx j=0; j < gout->nVertices; ++j)
+        for (EdgeIdx pos = gout->offsets[j]; pos < gout->offsets[j+1]; ++pos)
+            ret[cursor[gout->nbors[pos]]++] = pos;
+
+    delete[] cursor;
+    return ret;
+}
+
+// Number of wedges generated from i by addFourCycleWedges, used to schedule vertices.
+EdgeIdx fourCycleWork(CGraph *gout, CGraph *gin, VertexIdx i)
 {
    EdgeIdx ret = 0;
+   for (EdgeIdx pos = gin->offsets[i]; pos < gin->offsets[i+1]; ++pos)
+   {
+       VertexIdx j = gin->nbors[pos];
+       ret += (gout->offsets[j+1] - gout->offsets[j]) + (gin->offsets[j+1] - gin->offsets[j]);
+   }
+   return ret;
+}
 
-   VertexIdx i,j,k;
+// Returns the vertices with more than 1/(4*nthreads) of the total work. These are split
+// across threads by splitFourCyclesAt, rather than handled by a single thread.
+std::vector<VertexIdx> heavyVertices(VertexIdx n, const EdgeIdx *work, int nthreads)
+{
+   std::vector<VertexIdx> ret;
+   if (nthreads == 1)
+       return ret;
+   EdgeIdx total_work = 0;
+   for (VertexIdx i=0; i < n; ++i)
+       total_work += work[i];
+   for (VertexIdx i=0; i < n; ++i)
+       if (work[i] > total_work/(4*nthreads))
+           ret.push_back(i);
+   return ret;
+}
 
-   VertexIdx *wedge_count = new VertexIdx[gout->nVertices+1]; //stores number of wedges ending at a vertex
-   for (i=0; i < gout->nVertices; i++) //initialize all wedge_count values to 0
-       wedge_count[i] = 0;
+// Counts the 4-cycles whose highest vertex is i, using the scratch of a single thread.
+// inToOut is only needed (and perEdge only used) when perVertex is given.
+EdgeIdx fourCyclesAt(CGraph *gout, CGraph *gin, const EdgeIdx *inToOut, VertexIdx i, WedgeScratch &scratch, Count *perVertex, Count *perEdge)
+{
+   addFourCycleWedges(gout, gin, i, gin->offsets[i], gin->offsets[i+1], scratch);
+   if (perVertex)
+       addFourCyclesToWedges(gout, gin, inToOut, i, gin->offsets[i], gin->offsets[i+1], scratch.wedge_count, perVertex, perEdge);
+   return collectFourCycles(scratch, i, perVertex);
+}
 
-   for (i=0; i < gin->nVertices; ++i) // loop over vertices
+// Same as fourCyclesAt, but the in-neighbors of i are split across all threads, and the
+// per-thread wedge counts are merged into scratch[0] before the four-cycles are collected.
+// Must be called from outside of any parallel loop.
+EdgeIdx splitFourCyclesAt(CGraph *gout, CGraph *gin, const EdgeIdx *inToOut, VertexIdx i, std::vector<WedgeScratch> &scratch, Count *perVertex, Count *perEdge)
+{
+   int nthreads = scratch.size();
+   parallelFor(gin->offsets[i], gin->offsets[i+1], 64, nthreads, [&](int tid, EdgeIdx pos)
    {
-       for (EdgeIdx pos = gin->offsets[i]; pos < gin->offsets[i+1]; ++pos) // loop over in-neighbors of i
-       {
-           j = gin->nbors[pos]; // j is current in-neighbor
-           for (EdgeIdx next = gout->offsets[j]; next < gout -> offsets[j+1]; ++next) // loop over out-neighbors of j, note this gives an outout wedge
-           {
-               k = gout->nbors[next];  // i <- j -> k is outout wedge centered at j
-               if (k>=i)   // break ties to prevent overcount
-                   continue;
-               wedge_count[k]++; // increment number of wedges ending at k
-           }
-           for (EdgeIdx next = gin->offsets[j]; next < gin->offsets[j+1]; ++next) // loop over in-neighbors of j, note this gives inout wedge
-           {
-               k = gin->nbors[next]; // i <- j <- k is inout wedge centered at j
-               wedge_count[k]++; // increment number of wedges ending at k
-           }
-       }
+       addFourCycleWedges(gout, gin, i, pos, pos+1, scratch[tid]);
+   });
 
-       for (EdgeIdx pos = gin->offsets[i]; pos < gin->offsets[i+1]; ++pos) // loop over in-neighbors of i
+   // merge the wedge counts of all threads into thread 0
+   for (int t=1; t < nthreads; t++)
+   {
+       for (VertexIdx k : scratch[t].touched)
        {
-           j = gin->nbors[pos]; // j is current in-neighbor
-           for (EdgeIdx next = gout->offsets[j]; next < gout -> offsets[j+1]; ++next) // loop over out-neighbors of j, note this gives an outout wedge
-           {
-               k = gout->nbors[next];  // i <- j -> k is outout wedge centered at j
-//                printf("outout %ld %ld, count %ld\n",i,k,wedge_count[k]);
-               ret += (wedge_count[k]*(wedge_count[k]-1))/2; // every pair of wedges ending at k yields a four-cycle
-               wedge_count[k] = 0; //reset value of wedge_count
-           }
-           for (EdgeIdx next = gin->offsets[j]; next < gin->offsets[j+1]; ++next) // loop over in-neighbors of j, note this gives inout wedge
-           {
-               k = gin->nbors[next]; // i <- j <- k is inout wedge centered at j
-//                printf("inin %ld %ld, count %ld\n",i,k,wedge_count[k]);
-               ret += (wedge_count[k]*(wedge_count[k]-1))/2; // every pair of wedges ending at k yields a four-cycle
-               wedge_count[k] = 0; //reset value of wedge_count
-           }
+           if (scratch[0].wedge_count[k] == 0)
+               scratch[0].touched.push_back(k);
+           scratch[0].wedge_count[k] += scratch[t].wedge_count[k];
+           scratch[t].wedge_count[k] = 0;
        }
+       scratch[t].touched.clear();
    }
+   if (perVertex)
+       parallelFor(gin->offsets[i], gin->offsets[i+1], 64, nthreads, [&](int tid, EdgeIdx pos)
+       {
+           addFourCyclesToWedges(gout, gin, inToOut, i, pos, pos+1, scratch[0].wedge_count, perVertex, perEdge);
+       });
+   return collectFourCycles(scratch[0], i, perVertex);
+}
+
+// Four-cycle counter
+// Input: The out-DAG and in-DAG of a degree ordered graph
+// Output: The number of 4-cycles
+//
+// Every 4-cycle is counted at its highest vertex i, as a pair of wedges from i that
+// end at the same vertex. The vertices are processed in parallel, with per-thread
+// wedge counts, and blocks of vertices are scheduled by the number of wedges they generate.
+// The few vertices that generate a large fraction of all wedges are handled separately:
+// their in-neighbors are split across all threads, and the per-thread wedge counts are
+// merged before the four-cycles are collected.
+//
+// If perVertex and perEdge are given (both, or neither), they also get the number of 4-cycles
+// containing each vertex, and each edge of gout (indexed by position in gout->nbors).
+// They must be initialized by the caller.
+
+EdgeIdx fourCycleCounter(CGraph *gout, CGraph *gin, Count *perVertex = NULL, Count *perEdge = NULL)
+{
+   EdgeIdx ret = 0;
+   int nthreads = numThreads();
+
+   // work[i] is the number of wedges generated from i
+   EdgeIdx *work = new EdgeIdx[gin->nVertices+1];
+   for (VertexIdx i=0; i < gin->nVertices; ++i)
+       work[i] = fourCycleWork(gout, gin, i);
+
+   std::vector<VertexIdx> heavy = heavyVertices(gin->nVertices, work, nthreads);
+   for (VertexIdx i : heavy)
+       work[i] = -1; // marks i as heavy, so that the vertex loop skips it
+
+   EdgeIdx *inToOut = NULL;
+   if (perVertex)
+       inToOut = inToOutPositions(gout, gin);
+
+   std::vector<WedgeScratch> scratch(nthreads);
+   std::vector<PaddedCount> partial(nthreads, PaddedCount{0, {}});
+   for (int t=0; t < nthreads; t++)
+       scratch[t] = newWedgeScratch(gout->nVertices);
+
+   parallelForWeighted(gin->nVertices, work, nthreads, [&](int tid, VertexIdx i)
+   {
+       if (work[i] < 0) // heavy vertex, handled below
+           return;
+       partial[tid].value += fourCyclesAt(gout, gin, inToOut, i, scratch[tid], perVertex, perEdge);
+   });
+
+   for (VertexIdx i : heavy)
+       partial[0].value += splitFourCyclesAt(gout, gin, inToOut, i, scratch, perVertex, perEdge);
+
+   for (int t=0; t < nthreads; t++)
+   {
+       ret += partial[t].value;
+       delWedgeScratch(scratch[t]);
+   }
+   delete[] work;
+   delete[] inToOut;
    return ret;
 }
 
@@ -288,65 +489,222 @@ EdgeIdx oldfourCycleCounter(CGraph *gout, CGraph *gin)
    return ret;
 }
 
+// Counts the 4-cliques whose lowest vertex is the center i of nb: these are the triangles
+// (j,k,ell) of the neighborhood. If perVertex is given, they are also added to perVertex
+// and perEdge, as in fourCliqueCounter.
+EdgeIdx localFourCliques(const OutNeighborhood &nb, Count *perVertex, Count *perEdge)
+{
+    EdgeIdx count = 0;
+    for (VertexIdx j=0; j < nb.size; ++j) // loop over local edges (j,k)
+        for (EdgeIdx posk = nb.offsets[j]; posk < nb.offsets[j+1]; ++posk)
+        {
+            VertexIdx k = nb.nbors[posk];
+            if (perVertex == NULL)
+            {
+                count += countLocalCommon(nb, j, k); // every common out-neighbor ell gives 4-clique (i,j,k,ell)
+                continue;
+            }
+
+            Count cliques = 0; // 4-cliques on triangle (i,j,k)
+            forEachLocalCommon(nb, j, k, [&](VertexIdx ell, EdgeIdx posjell, EdgeIdx poskell)
+            {
+                ++cliques;
+                atomicAdd(perVertex+nb.vertices[ell], 1);
+                atomicAdd(perEdge+nb.firstEdge+ell, 1);
+                atomicAdd(perEdge+nb.edges[posjell], 1);
+                atomicAdd(perEdge+nb.edges[poskell], 1);
+            });
+            atomicAdd(perVertex+nb.vertices[j], cliques);
+            atomicAdd(perVertex+nb.vertices[k], cliques);
+            atomicAdd(perEdge+nb.firstEdge+j, cliques);
+            atomicAdd(perEdge+nb.firstEdge+k, cliques);
+            atomicAdd(perEdge+nb.edges[posk], cliques);
+            count += cliques;
+        }
+    if (perVertex)
+        atomicAdd(perVertex+nb.center, count);
+    return count;
+}
+
 // Four-clique counter
 // Input: The out-DAG of a graph sorted by ID (It is *critical* that DAG is sorted by ID, not be degree.)
 // Output: The number of 4-cliques
+//
+// Every 4-clique is counted at its lowest vertex i, as a triangle (j,k,ell) in the subgraph
+// induced by the out-neighborhood of i. That subgraph is small, so it is loaded with local ids
+// into an OutNeighborhood, and the triangles on each local edge (j,k) are the common
+// out-neighbors of j and k, found with a bitmap AND + popcount (or a merge of sorted local lists
+// for very large neighborhoods). Vertices are processed in parallel, scheduled by the cost of
+// loading their neighborhoods.
+//
+// If perVertex and perEdge are given (both, or neither), they also get the number of 4-cliques
+// containing each vertex, and each edge of gout (indexed by position in gout->nbors).
+// They must be initialized by the caller.
 
-EdgeIdx fourCliqueCounter(CGraph *gout)
+EdgeIdx fourCliqueCounter(CGraph *gout, Count *perVertex = NULL, Count *perEdge = NULL)
 {
     EdgeIdx ret = 0; // return value
-    VertexIdx *triends = new VertexIdx[gout->nVertices+1]; // array to store triangle ends
+    int nthreads = numThreads();
 
-    for (VertexIdx i=0; i < gout->nVertices; ++i) // loop over vertices
-        for (VertexIdx posj = gout->offsets[i]; posj < gout->offsets[i+1]; ++posj) // loop over out-neighbors of i
+    EdgeIdx *work = new EdgeIdx[gout->nVertices+1]; // work[i] is the number of edges scanned to load out-neighborhood of i
+    for (VertexIdx i=0; i < gout->nVertices; ++i)
+    {
+        work[i] = 0;
+        for (EdgeIdx posj = gout->offsets[i]; posj < gout->offsets[i+1]; ++posj)
         {
-            VertexIdx j = gout->nbors[posj]; // j is current out-neighbor
-            VertexIdx count = 0;
-            for (VertexIdx posk = posj+1; posk < gout->offsets[i+1]; ++posk) // loop over another out-neighbor of i, that is "ahead" of j in list of out-neighbors
-            {
-                VertexIdx k = gout->nbors[posk]; // k is next out-neighbor
-//                 printf("looking at tri %ld %ld %ld\n",i,j,k);
-                if (gout->isEdgeBinary(j,k)) // check if edge (j,k) is present
-                {
-                    triends[count] = k;  // so (i,j,k) form a triangle. we store the fact that k forms a triangle with edge (i,j) in digraph gout
-                    ++count;
-                }
-            }
+            VertexIdx j = gout->nbors[posj];
+            work[i] += gout->offsets[j+1] - gout->offsets[j];
+        }
+    }
 
-            for (VertexIdx posk = 0; posk < count; ++posk) // loop over all pairs of triangles formed by (i,j)
-            {
-                VertexIdx k = triends[posk]; // k is vertex as index posk in triends
-                VertexIdx degk = gout->offsets[k+1] - gout->offsets[k]; // gettting degree of k in gout
-                VertexIdx remaining = count-posk; // number of vertices that k needs to be checked with
-
-//                 printf("looking at %ld %ld %ld\n",i,j,k);
-                if (degk >= remaining)
-                {   
-                    // We will search all other vertices in triends in k's adj list
-                    for (VertexIdx posell = posk+1; posell < count; ++posell)
-                    {
-                        VertexIdx ell = triends[posell]; 
-//                         printf("Going to triends %ld %ld %ld %ld\n",i,j,k,ell);
-                        if (gout->isEdgeBinary(k,ell)) // (k,ell) is an end, thus (i,j,k,ell) form a 4-clique
-                        {
-                            ++ret;
-                        }
-                    }
-                }
-                else
-                {
-                    // We will search all vertices in k's adj list in the remaining portion of triends
-                    for (EdgeIdx posell = gout->offsets[k]; posell < gout->offsets[k+1]; posell++)
-                    {
-                        VertexIdx ell = gout->nbors[posell];
-                        if (binarySearch(triends+posk+1,count-posk-1,ell) != -1)
-                        {
-                            ++ret;
-                        }
-                    }
-                }
-            }
+    std::vector<OutNeighborhood> nbs(nthreads);
+    std::vector<PaddedCount> partial(nthreads, PaddedCount{0, {}});
+    for (int t=0; t < nthreads; t++)
+        nbs[t] = newOutNeighborhood(gout);
+
+    parallelForWeighted(gout->nVertices, work, nthreads, [&](int tid, VertexIdx i)
+    {
+        if (gout->offsets[i+1] - gout->offsets[i] < 3) // no 4-clique has i as lowest vertex
+            return;
+        loadOutNeighborhood(gout, i, nbs[tid]);
+        partial[tid].value += localFourCliques(nbs[tid], perVertex, perEdge);
+    });
+
+    for (int t=0; t < nthreads; t++)
+    {
+        ret += partial[t].value;
+        delOutNeighborhood(nbs[t]);
+    }
+    delete[] work;
+    return ret;
+}
+
+// Adds the triangles whose lowest vertex is the center i of nb to info: these are the edges
+// (a,b) of the neighborhood. tri is scratch of at least nb.size entries.
+// Returns the number of such triangles.
+EdgeIdx addLocalTriangles(const OutNeighborhood &nb, TriangleInfo &info, std::vector<Count> &tri)
+{
+    tri.assign(nb.size, 0); // tri[a] is the number of triangles (i, a, .) found here
+    for (VertexIdx a=0; a < nb.size; ++a)
+        for (EdgeIdx posb = nb.offsets[a]; posb < nb.offsets[a+1]; ++posb)
+        {
+            ++tri[a];
+            ++tri[nb.nbors[posb]];
+            atomicAdd(info.perEdge+nb.edges[posb], 1);
+        }
+    for (VertexIdx a=0; a < nb.size; ++a)
+    {
+        atomicAdd(info.perVertex+nb.vertices[a], tri[a]);
+        atomicAdd(info.perEdge+nb.firstEdge+a, tri[a]);
+    }
+    EdgeIdx count = nb.nbors.size();
+    atomicAdd(info.perVertex+nb.center, count);
+    return count;
+}
+
+struct FourVertexPass
+{
+    EdgeIdx triangles;
+    EdgeIdx fourcycles;
+    EdgeIdx fourcliques;
+};
+
+// Fused four-vertex counter
+// Input: The out-DAG and in-DAG of a degree ordered graph, both sorted by ID, and optionally
+//        a TriangleInfo allocated for gout (with newTriangleInfo)
+// Output: The number of triangles (if info is given), 4-cycles and 4-cliques
+//
+// This does the work of betterWedgeEnumerator, fourCycleCounter and fourCliqueCounter in a
+// single parallel pass over the vertices. At every vertex i, the out-neighborhood of i is
+// loaded once: its edges are the triangles with lowest vertex i (added to info), and its
+// triangles are the 4-cliques with lowest vertex i. The 4-cycles with highest vertex i are
+// counted by the same thread right after, from the wedges through the in-neighbors of i.
+// The vertices with the most wedges are handled separately, as in fourCycleCounter.
+//
+// info, if given, is initialized here, and its perEdge is indexed by position in gout->nbors.
+// The optional per-vertex and per-edge 4-cycle and 4-clique counts are as in fourCycleCounter
+// and fourCliqueCounter, and must be initialized by the caller.
+// With countCycles (countCliques) false, 4-cycles (4-cliques) are not counted, and returned as 0.
+
+FourVertexPass fourVertexCounter(CGraph *gout, CGraph *gin, TriangleInfo *info, Count *cyclesPerVertex = NULL, Count *cyclesPerEdge = NULL, Count *cliquesPerVertex = NULL, Count *cliquesPerEdge = NULL, bool countCycles = true, bool countCliques = true)
+{
+    FourVertexPass ret = {0, 0, 0};
+    int nthreads = numThreads();
+
+    if (info)
+    {
+        std::fill(info->perVertex, info->perVertex+gout->nVertices, 0);
+        std::fill(info->perEdge, info->perEdge+gout->nEdges, 0);
+    }
+
+    // cycle_work[i] is the number of wedges generated from i, work[i] adds the cost of loading the out-neighborhood of i
+    EdgeIdx *cycle_work = new EdgeIdx[gout->nVertices+1];
+    EdgeIdx *work = new EdgeIdx[gout->nVertices+1];
+    for (VertexIdx i=0; i < gout->nVertices; ++i)
+    {
+        cycle_work[i] = countCycles ? fourCycleWork(gout, gin, i) : -1; // -1: no 4-cycles are counted at i
+        work[i] = std::max<EdgeIdx>(cycle_work[i], 0);
+        for (EdgeIdx posj = gout->offsets[i]; posj < gout->offsets[i+1]; ++posj)
+        {
+            VertexIdx j = gout->nbors[posj];
+            work[i] += gout->offsets[j+1] - gout->offsets[j];
+        }
+    }
+
+    std::vector<VertexIdx> heavy;
+    if (countCycles)
+        heavy = heavyVertices(gout->nVertices, cycle_work, nthreads);
+    for (VertexIdx i : heavy)
+        cycle_work[i] = -1; // marks i as heavy, so that its 4-cycles are skipped in the vertex loop
+
+    EdgeIdx *inToOut = NULL;
+    if (countCycles && cyclesPerVertex)
+        inToOut = inToOutPositions(gout, gin);
+
+    std::vector<OutNeighborhood> nbs(nthreads);
+    std::vector<WedgeScratch> scratch(nthreads);
+    std::vector<std::vector<Count> > tri(nthreads);
+    std::vector<PaddedCount> triangles(nthreads, PaddedCount{0, {}});
+    std::vector<PaddedCount> cycles(nthreads, PaddedCount{0, {}});
+    std::vector<PaddedCount> cliques(nthreads, PaddedCount{0, {}});
+    for (int t=0; t < nthreads; t++)
+    {
+        nbs[t] = newOutNeighborhood(gout);
+        scratch[t] = newWedgeScratch(countCycles ? gout->nVertices : 0);
+    }
+
+    parallelForWeighted(gout->nVertices, work, nthreads, [&](int tid, VertexIdx i)
+    {
+        VertexIdx outdeg = gout->offsets[i+1] - gout->offsets[i];
+        if ((countCliques && outdeg >= 3) || (info && outdeg >= 2)) // i is the lowest vertex of some triangle or 4-clique
+        {
+            OutNeighborhood &nb = nbs[tid];
+            loadOutNeighborhood(gout, i, nb);
+            if (info)
+                triangles[tid].value += addLocalTriangles(nb, *info, tri[tid]);
+            if (countCliques && outdeg >= 3)
+                cliques[tid].value += localFourCliques(nb, cliquesPerVertex, cliquesPerEdge);
         }
+        if (cycle_work[i] >= 0)
+            cycles[tid].value += fourCyclesAt(gout, gin, inToOut, i, scratch[tid], cyclesPerVertex, cyclesPerEdge);
+    });
+
+    for (VertexIdx i : heavy)
+        cycles[0].value += splitFourCyclesAt(gout, gin, inToOut, i, scratch, cyclesPerVertex, cyclesPerEdge);
+
+    for (int t=0; t < nthreads; t++)
+    {
+        ret.triangles += triangles[t].value;
+        ret.fourcycles += cycles[t].value;
+        ret.fourcliques += cliques[t].value;
+        delOutNeighborhood(nbs[t]);
+        delWedgeScratch(scratch[t]);
+    }
+    if (info)
+        info->total = ret.triangles;
+    delete[] cycle_work;
+    delete[] work;
+    delete[] inToOut;
     return ret;
 }
 
@@ -389,6 +747,200 @@ EdgeIdx oldfourCliqueCounter(CGraph *gout)
 }
 
 
+// Local 4-vertex counts.
+// For every vertex v and pattern p (in the order of nonInd in getAllFour), perVertex[11*v+p] is the
+// number of non-induced copies of p that contain v. For every edge e of the out-DAG (indexed by
+// position in gout->nbors, so every undirected edge appears once), perEdge[11*e+p] is the number of
+// copies of p that use e as one of their edges. Like the global counts, these are doubles, since the
+// counts of the disconnected patterns grow like n^3.
+
+struct LocalFourCounts
+{
+    VertexIdx nVertices;
+    EdgeIdx nEdges;
+    double *perVertex;
+    double *perEdge;
+};
+
+LocalFourCounts newLocalFourCounts(CGraph *gout)
+{
+    LocalFourCounts ret;
+    ret.nVertices = gout->nVertices;
+    ret.nEdges = gout->nEdges;
+    ret.perVertex = new double[11*gout->nVertices+1];
+    ret.perEdge = new double[11*gout->nEdges+1];
+    return ret;
+}
+
+void delLocalFourCounts(LocalFourCounts &local)
+{
+    delete[] local.perVertex;
+    delete[] local.perEdge;
+}
+
+// Fills local, given the triangle info of gout and the local 4-cycle and 4-clique counts
+// (from fourCycleCounter and fourCliqueCounter).
+//
+// The other patterns are counted as in easyFourCounter, but only over copies through a fixed vertex
+// v or edge e = (u,v). Let d_v be the degree, t_v and t_e the triangle counts, S_v the sum of the degrees
+// of the neighbors of v, and W and T the total number of wedges and triangles. For vertex v:
+//
+// #3-stars = {d_v \choose 3} + \sum_{u ~ v} {d_u-1 \choose 2}                      (v is center, or a leaf)
+// #3-paths = \sum_{u ~ v} [(d_v-1)(d_u-1) - t_vu] + \sum_{u ~ v} S_u - d_v^2 - S_v + d_v - 2t_v (v is inside, or an end)
+// #tailed-triangles = \sum_{u ~ v} (t_u - t_vu) + (d_v-2)t_v + \sum_{u ~ v} t_vu (d_u-2)  (v is end of tail, base of tail, or other)
+// #chordal-cycles = \sum_{u ~ v} {t_vu \choose 2} + \sum_{triangles (v,a,b)} (t_ab - 1)  (v is on the chord, or not)
+//
+// and for edge e = (u,v):
+//
+// #3-stars = {d_u-1 \choose 2} + {d_v-1 \choose 2}
+// #3-paths = (d_u-1)(d_v-1) - t_e + (S_u - d_u - d_v + 1 - t_e) + (S_v - d_u - d_v + 1 - t_e)
+// #tailed-triangles = t_u + t_v - 2t_e + \sum_{triangles (u,v,w)} (d_u + d_v + d_w - 6)   (e is the tail, or in the triangle)
+// #chordal-cycles = {t_e \choose 2} + \sum_{triangles (u,v,w)} (t_uw - 1) + (t_vw - 1)   (e is the chord, or not)
+//
+// The sums over triangles are done in parallel with one more pass over the out-neighborhoods.
+
+void localFourCounts(CGraph *g, CGraph *gout, TriangleInfo *info, Count *cyclesPerVertex, Count *cyclesPerEdge, Count *cliquesPerVertex, Count *cliquesPerEdge, LocalFourCounts &local)
+{
+    VertexIdx nv = g->nVertices;
+    double n = nv, m = gout->nEdges, W = 0, T = info->total;
+    Count *deg = new Count[nv+1];
+    Count *nbr_deg = new Count[nv+1];      // S_v
+    for (VertexIdx v=0; v < nv; v++)
+    {
+        deg[v] = g->offsets[v+1] - g->offsets[v];
+        W += (double) deg[v]*(deg[v]-1)/2;
+    }
+    for (VertexIdx v=0; v < nv; v++)
+    {
+        nbr_deg[v] = 0;
+        for (EdgeIdx pos = g->offsets[v]; pos < g->offsets[v+1]; pos++)
+            nbr_deg[v] += deg[g->nbors[pos]];
+    }
+
+    // sums over the neighbors u of v, all done with one pass over the edges of gout
+    Count *star_leaf = new Count[nv+1];    // \sum_u {d_u-1 \choose 2}
+    Count *path_inside = new Count[nv+1];  // \sum_u (d_v-1)(d_u-1) - t_vu
+    Count *nbr_nbr_deg = new Count[nv+1];  // \sum_u S_u
+    Count *tail_end = new Count[nv+1];     // \sum_u t_u - t_vu
+    Count *tail_other = new Count[nv+1];   // \sum_u t_vu (d_u-2)
+    Count *chord = new Count[nv+1];        // \sum_u {t_vu \choose 2}
+    Count *tip = new Count[nv+1];          // \sum_{triangles (v,a,b)} t_ab - 1
+    for (VertexIdx v=0; v < nv; v++)
+        star_leaf[v] = path_inside[v] = nbr_nbr_deg[v] = tail_end[v] = tail_other[v] = chord[v] = tip[v] = 0;
+
+    for (VertexIdx i=0; i < nv; i++)
+        for (EdgeIdx pos = gout->offsets[i]; pos < gout->offsets[i+1]; pos++)
+        {
+            VertexIdx j = gout->nbors[pos];
+            Count te = info->perEdge[pos];
+            star_leaf[i] += (deg[j]-1)*(deg[j]-2)/2;
+            star_leaf[j] += (deg[i]-1)*(deg[i]-2)/2;
+            path_inside[i] += (deg[i]-1)*(deg[j]-1) - te;
+            path_inside[j] += (deg[i]-1)*(deg[j]-1) - te;
+            nbr_nbr_deg[i] += nbr_deg[j];
+            nbr_nbr_deg[j] += nbr_deg[i];
+            tail_end[i] += info->perVertex[j] - te;
+            tail_end[j] += info->perVertex[i] - te;
+            tail_other[i] += te*(deg[j]-2);
+            tail_other[j] += te*(deg[i]-2);
+            chord[i] += te*(te-1)/2;
+            chord[j] += te*(te-1)/2;
+        }
+
+    // sums over triangles, for vertices and edges
+    Count *tri_tail = new Count[gout->nEdges+1];   // \sum_{triangles (u,v,w)} d_w - 2
+    Count *tri_side = new Count[gout->nEdges+1];   // \sum_{triangles (u,v,w)} (t_uw - 1) + (t_vw - 1)
+    for (EdgeIdx e=0; e < gout->nEdges; e++)
+        tri_tail[e] = tri_side[e] = 0;
+
+    int nthreads = numThreads();
+    std::vector<OutNeighborhood> nbs(nthreads);
+    for (int t=0; t < nthreads; t++)
+        nbs[t] = newOutNeighborhood(gout);
+    parallelFor(0, nv, 64, nthreads, [&](int tid, EdgeIdx i)
+    {
+        if (gout->offsets[i+1] - gout->offsets[i] < 2)
+            return;
+        OutNeighborhood &nb = nbs[tid];
+        loadOutNeighborhood(gout, i, nb);
+        Count tip_i = 0;
+        for (VertexIdx a=0; a < nb.size; a++)
+            for (EdgeIdx p = nb.offsets[a]; p < nb.offsets[a+1]; p++) // triangle (i, x, y) with edges ix, iy, xy
+            {
+                VertexIdx b = nb.nbors[p];
+                VertexIdx x = nb.vertices[a], y = nb.vertices[b];
+                EdgeIdx eix = nb.firstEdge+a, eiy = nb.firstEdge+b, exy = nb.edges[p];
+                Count tix = info->perEdge[eix], tiy = info->perEdge[eiy], txy = info->perEdge[exy];
+
+                tip_i += txy-1;
+                atomicAdd(tip+x, tiy-1);
+                atomicAdd(tip+y, tix-1);
+
+                atomicAdd(tri_tail+eix, deg[y]-2);
+                atomicAdd(tri_tail+eiy, deg[x]-2);
+                atomicAdd(tri_tail+exy, deg[i]-2);
+
+                atomicAdd(tri_side+eix, tiy+txy-2);
+                atomicAdd(tri_side+eiy, tix+txy-2);
+                atomicAdd(tri_side+exy, tix+tiy-2);
+            }
+        atomicAdd(tip+i, tip_i);
+    });
+    for (int t=0; t < nthreads; t++)
+        delOutNeighborhood(nbs[t]);
+
+    parallelFor(0, nv, 256, nthreads, [&](int tid, EdgeIdx v)
+    {
+        double d = deg[v], S = nbr_deg[v], t = info->perVertex[v];
+        double Wv = d*(d-1)/2 + S - d; // wedges containing v
+        double *out = local.perVertex + 11*v;
+
+        out[0] = (n-1)*(n-2)*(n-3)/6;
+        out[1] = d*(n-2)*(n-3)/2 + (m-d)*(n-3);
+        out[2] = d*(m-d+1) - S;
+        out[3] = Wv*(n-3) + (W-Wv);
+        out[4] = t*(n-3) + (T-t);
+        out[5] = d*(d-1)*(d-2)/6 + star_leaf[v];
+        out[6] = path_inside[v] + (double) nbr_nbr_deg[v] - d*d - S + d - 2*t;
+        out[7] = tail_end[v] + (d-2)*t + tail_other[v];
+        out[8] = cyclesPerVertex[v];
+        out[9] = chord[v] + tip[v];
+        out[10] = cliquesPerVertex[v];
+
+        for (EdgeIdx pos = gout->offsets[v]; pos < gout->offsets[v+1]; pos++)
+        {
+            VertexIdx u = gout->nbors[pos];
+            double du = deg[u], te = info->perEdge[pos];
+            double *eout = local.perEdge + 11*pos;
+
+            eout[0] = 0;
+            eout[1] = (n-2)*(n-3)/2;
+            eout[2] = m - d - du + 1;
+            eout[3] = (d+du-2)*(n-3);
+            eout[4] = te*(n-3);
+            eout[5] = (d-1)*(d-2)/2 + (du-1)*(du-2)/2;
+            eout[6] = (d-1)*(du-1) - te + (S-d-du+1-te) + (nbr_deg[u]-d-du+1-te);
+            eout[7] = t + info->perVertex[u] - 2*te + te*(d+du-4) + tri_tail[pos];
+            eout[8] = cyclesPerEdge[pos];
+            eout[9] = te*(te-1)/2 + tri_side[pos];
+            eout[10] = cliquesPerEdge[pos];
+        }
+    });
+
+    delete[] deg;
+    delete[] nbr_deg;
+    delete[] star_leaf;
+    delete[] path_inside;
+    delete[] nbr_nbr_deg;
+    delete[] tail_end;
+    delete[] tail_other;
+    delete[] chord;
+    delete[] tip;
+    delete[] tri_tail;
+    delete[] tri_side;
+}
+
+
 #endif
 
 
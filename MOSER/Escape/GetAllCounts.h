@@ -2,6 +2,10 @@
 #define ESCAPE_GETALLCOUNTS_H_
 
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <initializer_list>
 
 #include "Escape/FourVertex.h"
 #include "Escape/Utils.h"
@@ -21,6 +25,89 @@
 
 using namespace Escape;
 
+// Pattern masks select the patterns to count, for callers that need only some of them.
+// Bit p of a mask stands for pattern p, in the order of the counts in nonInd (and in out.txt).
+// Counts of patterns outside the mask are not computed, and set to NAN.
+
+typedef uint64_t PatternMask;
+
+const PatternMask allPatterns = ~((PatternMask) 0);
+
+bool hasPattern(PatternMask mask, int p)
+{
+    return (mask >> p) & 1;
+}
+
+PatternMask patternBits(std::initializer_list<int> patterns)
+{
+    PatternMask ret = 0;
+    for (int p : patterns)
+        ret |= ((PatternMask) 1) << p;
+    return ret;
+}
+
+// Returns the non-induced counts that the induced counts in mask are computed from. The
+// induced count of p is a combination of the non-induced counts in row p of the NonToInd matrix.
+PatternMask fourNonInducedNeeded(PatternMask induced)
+{
+    PatternMask ret = 0;
+    for (int p = 0; p < 11; p++)
+        for (int q = p; q < 11; q++)
+            if (hasPattern(induced, p) && FourNonToIndMatrix[p][q] != 0)
+                ret |= patternBits({q});
+    return ret;
+}
+
+PatternMask fiveNonInducedNeeded(PatternMask induced)
+{
+    PatternMask ret = 0;
+    for (int p = 0; p < 34; p++)
+        for (int q = p; q < 34; q++)
+            if (hasPattern(induced, p) && FiveNonToIndMatrix[p][q] != 0)
+                ret |= patternBits({q});
+    return ret;
+}
+
+// Returns the non-induced 4-vertex counts that getAllFive uses for the non-induced 5-vertex counts in mask
+PatternMask fourNeededForFive(PatternMask mask)
+{
+    PatternMask ret = mask & patternBits({5, 6, 7, 8, 9, 10}); // 4-vertex patterns plus an isolated vertex
+    if (hasPattern(mask, 11))
+        ret |= patternBits({5, 6});
+    if (hasPattern(mask, 12))
+        ret |= patternBits({7});
+    if (mask & patternBits({13, 14, 15})) // trees
+        ret |= patternBits({7, 8});
+    if (mask & patternBits({16, 17, 18})) // triangles with tails
+        ret |= patternBits({7, 9});
+    if (mask & patternBits({19, 24})) // 4-cycle based
+        ret |= patternBits({9});
+    if (mask & patternBits({22, 28})) // cobra and triangle strip
+        ret |= patternBits({10});
+    return ret;
+}
+
+// Parses a comma separated list of patterns (such as "8,10") into a mask.
+// Returns 0 if the list is malformed, or has a pattern outside [0, npatterns).
+PatternMask parsePatternList(const char *list, int npatterns)
+{
+    PatternMask ret = 0;
+    const char *pos = list;
+    while (true)
+    {
+        char *end;
+        long p = strtol(pos, &end, 10);
+        if (end == pos || p < 0 || p >= npatterns)
+            return 0;
+        ret |= patternBits({(int) p});
+        if (*end == '\0')
+            return ret;
+        if (*end != ',')
+            return 0;
+        pos = end + 1;
+    }
+}
+
 // overloaded functions for 3-vertex and 4-vertex patterns
 TriangleInfo getAllThree(CGraph *cg, CDAG *dag, double (&nonInd)[4], bool flag)
 {
@@ -48,7 +135,8 @@ TriangleInfo getAllThree(CGraph *cg, CDAG *dag, double (&nonInd)[4], bool flag)
     return info;
 }
 
-void getAllFour(CGraph *cg, CDAG *dag, double (&nonInd)[11], TriangleInfo &tri_info)
+// With counted, also hands back the 64-bit totals of the counters of the connected patterns (see exactFour).
+void getAllFour(CGraph *cg, CDAG *dag, double (&nonInd)[11], TriangleInfo &tri_info, NoninducedFourCounts *counted = NULL)
 {
     double n, m, w, t;
     // TriangleInfo tri_info;
@@ -75,20 +163,117 @@ void getAllFour(CGraph *cg, CDAG *dag, double (&nonInd)[11], TriangleInfo &tri_i
     nonInd[4] = t * (n - 3);                            // number of only triangles
 
     // printf("Getting easy four vertex patterns\n");
-    SomeFourPatterns four_info = easyFourCounter(cg, &(dag->outlist));
-
-    // printf("Getting four cycles\n");
-    EdgeIdx fourcycles = fourCycleCounter(&(dag->outlist), &(dag->inlist));
+    SomeFourPatterns four_info = easyFourCounter(cg, &(dag->outlist), tri_info);
 
-    // printf("Getting four cliques\n");
-    EdgeIdx fourcliques = fourCliqueCounter(&(dag->outlist));
+    // printf("Getting four cycles and four cliques\n");
+    FourVertexPass pass = fourVertexCounter(&(dag->outlist), &(dag->inlist), NULL); // triangles are already in tri_info
 
     nonInd[5] = four_info.threestars;
     nonInd[6] = four_info.threepaths;
     nonInd[7] = four_info.tailedtris;
-    nonInd[8] = fourcycles;
+    nonInd[8] = pass.fourcycles;
     nonInd[9] = four_info.chordalcycles;
-    nonInd[10] = fourcliques;
+    nonInd[10] = pass.fourcliques;
+    if (counted)
+    {
+        counted->threestars = four_info.threestars;
+        counted->threepaths = four_info.threepaths;
+        counted->tailedtris = four_info.tailedtris;
+        counted->fourcycles = pass.fourcycles;
+        counted->chordalcycles = four_info.chordalcycles;
+        counted->fourcliques = pass.fourcliques;
+    }
+}
+
+// Exact 3-vertex and 4-vertex counts, for callers that track counts as integers (the chain
+// executables). The closed-form counts of patterns with isolated vertices grow like n^4 and
+// lose exactness as doubles, so they are recomputed here from n, m, w and t, and so are the
+// counts that follow from the degrees and the triangles at every vertex and edge (stars,
+// paths, tailed triangles and chordal cycles, as in easyFourCounter). Only the 4-cycles and
+// 4-cliques are taken over from the 64-bit totals of the counters (counted, from getAllFour).
+void exactThree(CGraph *cg, TriangleInfo &tri_info, WideCount (&exact)[4])
+{
+    WideCount n = cg->nVertices, m = 0, w = 0;
+    for (VertexIdx i = 0; i < cg->nVertices; i++)
+    {
+        WideCount deg = cg->offsets[i + 1] - cg->offsets[i];
+        m += deg;
+        w += (deg * (deg - 1)) / 2;
+    }
+    m /= 2;
+
+    exact[0] = (n * (n - 1) * (n - 2)) / 6;
+    exact[1] = m * (n - 2);
+    exact[2] = w;
+    exact[3] = tri_info.total;
+}
+
+// tri_info holds the triangles at every vertex, and on every edge of dag->outlist (as returned by getAllThree).
+void exactFour(CGraph *cg, CDAG *dag, TriangleInfo &tri_info, const NoninducedFourCounts &counted, WideCount (&exact)[11])
+{
+    WideCount n = cg->nVertices, m = 0, w = 0, t = tri_info.total;
+    WideCount threestars = 0, threepaths = 0, tailedtris = 0, chordalcycles = 0;
+    for (VertexIdx i = 0; i < cg->nVertices; i++)
+    {
+        WideCount deg = cg->offsets[i + 1] - cg->offsets[i];
+        m += deg;
+        w += (deg * (deg - 1)) / 2;
+        threestars += deg * (deg - 1) * (deg - 2) / 6;
+        tailedtris += (deg - 2) * tri_info.perVertex[i];
+    }
+    m /= 2;
+
+    CGraph *gout = &(dag->outlist);
+    for (VertexIdx i = 0; i < gout->nVertices; i++)
+        for (EdgeIdx pos = gout->offsets[i]; pos < gout->offsets[i + 1]; pos++)
+        {
+            VertexIdx j = gout->nbors[pos];
+            WideCount degi = cg->offsets[i + 1] - cg->offsets[i], degj = cg->offsets[j + 1] - cg->offsets[j];
+            WideCount tris = tri_info.perEdge[pos];
+            threepaths += (degi - 1) * (degj - 1);
+            chordalcycles += tris * (tris - 1) / 2;
+        }
+    threepaths -= 3 * t;
+
+    exact[0] = (n * (n - 1) * (n - 2) * (n - 3)) / 24;
+    exact[1] = m * ((n - 2) * (n - 3) / 2);
+    exact[2] = (m * (m - 1) / 2) - w;
+    exact[3] = w * (n - 3);
+    exact[4] = t * (n - 3);
+    exact[5] = threestars;
+    exact[6] = threepaths;
+    exact[7] = tailedtris;
+    exact[8] = counted.fourcycles;
+    exact[9] = chordalcycles;
+    exact[10] = counted.fourcliques;
+}
+
+// The 5-vertex patterns that are not connected (0 to 12) only depend on n, m and the 3-vertex
+// and 4-vertex counts, with the same formulas as in getAllFive. Fills in exact[0] to exact[12].
+void disconnectedFive(WideCount n, WideCount m, WideCount (&three)[4], WideCount (&four)[11], WideCount (&exact)[34])
+{
+    WideCount w = three[2], t = three[3];
+
+    exact[0] = (n * (n - 1) * (n - 2) * (n - 3) * (n - 4)) / 120;
+    exact[1] = m * ((n - 2) * (n - 3) * (n - 4) / 6);
+    exact[2] = ((m * (m - 1)) / 2 - w) * (n - 4);
+    exact[3] = w * ((n - 3) * (n - 4) / 2);
+    exact[4] = t * ((n - 3) * (n - 4) / 2);
+    for (int i = 5; i < 11; i++)
+        exact[i] = four[i] * (n - 4);
+    exact[11] = w * (m - 2) - 3 * t - 3 * four[5] - 2 * four[6];
+    exact[12] = t * (m - 3) - four[7];
+}
+
+// Exact 5-vertex counts, from the exact 3-vertex and 4-vertex counts and the 64-bit totals of the
+// counters of the connected patterns 13 to 33 (counted, from getAllFive). The patterns that are not
+// connected are computed as 128-bit integers.
+void exactFive(CGraph *cg, WideCount (&three)[4], WideCount (&four)[11], const EdgeIdx (&counted)[21], WideCount (&exact)[34])
+{
+    WideCount n = cg->nVertices, m = cg->nEdges / 2;
+    disconnectedFive(n, m, three, four, exact);
+    for (int i = 13; i < 34; i++)
+        exact[i] = counted[i - 13];
 }
 
 // This function generates all non-induced counts for 3-vertex patterns.
@@ -121,27 +306,28 @@ void getAllThree(CGraph *cg, CDAG *dag, double (&nonInd)[4])
 
     info = betterWedgeEnumerator(&(dag->outlist));
     nonInd[3] = info.total;
+    delTriangleInfo(info);
 }
 
-// This function generates all non-induced counts for up to 4-vertex patterns.
-// It is a wrapper function that calls the main algorithmic parts, and finally
-// calls conversion functions to get induced counts.
+// This function generates all non-induced counts for up to 4-vertex patterns, together with
+// the 3-vertex counts. Triangles (with per-vertex and per-edge counts), 4-cycles and 4-cliques
+// come from a single pass of fourVertexCounter, and the other patterns from the triangle counts.
 //
-// Input: pointer to CGraph, corresponding DAG, empty array nonInd with 11 entries
-// No output: nonInd will have non-induced counts
+// Input: pointer to CGraph, corresponding DAG, empty arrays nonIndThree and nonInd with 4 and 11 entries,
+//        optionally local counts (allocated with newLocalFourCounts(&(dag->outlist))), and the mask
+//        of 4-vertex counts to compute (ignored if local is given, since local counts need all of them)
+// Output: the TriangleInfo of dag->outlist, to be freed by the caller with delTriangleInfo.
+//         nonIndThree and nonInd will have non-induced counts, and local (if given) the per-vertex and per-edge counts
 
-void getAllFour(CGraph *cg, CDAG *dag, double (&nonInd)[11])
+TriangleInfo getAllThreeAndFour(CGraph *cg, CDAG *dag, double (&nonIndThree)[4], double (&nonInd)[11], LocalFourCounts *local = NULL, PatternMask mask = allPatterns)
 {
     double n, m, w, t;
-    TriangleInfo tri_info;
+    TriangleInfo tri_info = newTriangleInfo(&(dag->outlist));
 
     n = cg->nVertices;
 
     m = 0;
     w = 0;
-    tri_info = betterWedgeEnumerator(&(dag->outlist));
-    t = tri_info.total;
-
     for (VertexIdx i = 0; i < n; i++)
     {
         VertexIdx deg = cg->offsets[i + 1] - cg->offsets[i]; // degree of i
@@ -150,61 +336,118 @@ void getAllFour(CGraph *cg, CDAG *dag, double (&nonInd)[11])
     }
     m = m / 2;
 
+    // per-vertex and per-edge 4-cycles and 4-cliques, if local counts are requested
+    Count *cycles_v = NULL, *cycles_e = NULL, *cliques_v = NULL, *cliques_e = NULL;
+    if (local)
+    {
+        cycles_v = new Count[cg->nVertices+1];
+        cliques_v = new Count[cg->nVertices+1];
+        cycles_e = new Count[dag->outlist.nEdges+1];
+        cliques_e = new Count[dag->outlist.nEdges+1];
+        std::fill(cycles_v, cycles_v+cg->nVertices, 0);
+        std::fill(cliques_v, cliques_v+cg->nVertices, 0);
+        std::fill(cycles_e, cycles_e+dag->outlist.nEdges, 0);
+        std::fill(cliques_e, cliques_e+dag->outlist.nEdges, 0);
+    }
+
+    if (local)
+        mask = allPatterns;
+
+    printf("Getting triangles, four cycles and four cliques\n");
+    FourVertexPass pass = fourVertexCounter(&(dag->outlist), &(dag->inlist), &tri_info, cycles_v, cycles_e, cliques_v, cliques_e,
+                                            hasPattern(mask, 8), hasPattern(mask, 10));
+    t = tri_info.total;
+
+    nonIndThree[0] = (n * (n - 1) * (n - 2)) / 6; // number of independent sets
+    nonIndThree[1] = m * (n - 2);                 // number of plain edges
+    nonIndThree[2] = w;                           // number of plain wedges
+    nonIndThree[3] = t;                           // number of triangles
+
     nonInd[0] = (n * (n - 1) * (n - 2) * (n - 3)) / 24; // number of independent sets
     nonInd[1] = m * ((n - 2) * (n - 3) / 2);            // number of only edges
     nonInd[2] = (m * (m - 1) / 2) - w;                  // number of matchings
     nonInd[3] = w * (n - 3);                            // number of only wedges
     nonInd[4] = t * (n - 3);                            // number of only triangles
 
-    printf("Getting easy four vertex patterns\n");
-    SomeFourPatterns four_info = easyFourCounter(cg, &(dag->outlist));
-
-    printf("Getting four cycles\n");
-    EdgeIdx fourcycles = fourCycleCounter(&(dag->outlist), &(dag->inlist));
+    SomeFourPatterns four_info = {0, 0, 0, 0};
+    if (mask & patternBits({5, 6, 7, 9}))
+    {
+        printf("Getting easy four vertex patterns\n");
+        four_info = easyFourCounter(cg, &(dag->outlist), tri_info);
+    }
 
-    printf("Getting four cliques\n");
-    EdgeIdx fourcliques = fourCliqueCounter(&(dag->outlist));
+    if (local)
+    {
+        printf("Getting local counts\n");
+        localFourCounts(cg, &(dag->outlist), &tri_info, cycles_v, cycles_e, cliques_v, cliques_e, *local);
+        delete[] cycles_v;
+        delete[] cycles_e;
+        delete[] cliques_v;
+        delete[] cliques_e;
+    }
 
     nonInd[5] = four_info.threestars;
     nonInd[6] = four_info.threepaths;
     nonInd[7] = four_info.tailedtris;
-    nonInd[8] = fourcycles;
+    nonInd[8] = pass.fourcycles;
     nonInd[9] = four_info.chordalcycles;
-    nonInd[10] = fourcliques;
+    nonInd[10] = pass.fourcliques;
+    for (int p = 0; p < 11; p++)
+        if (!hasPattern(mask, p))
+            nonInd[p] = NAN;
+    return tri_info;
+}
+
+// This function generates all non-induced counts for up to 4-vertex patterns.
+// It is a wrapper around getAllThreeAndFour, for callers that do not need the 3-vertex counts.
+//
+// Input: pointer to CGraph, corresponding DAG, empty array nonInd with 11 entries,
+//        and optionally local counts (allocated with newLocalFourCounts(&(dag->outlist)))
+// No output: nonInd will have non-induced counts, and local (if given) the per-vertex and per-edge counts
+
+void getAllFour(CGraph *cg, CDAG *dag, double (&nonInd)[11], LocalFourCounts *local = NULL)
+{
+    double nonIndThree[4];
+    TriangleInfo tri_info = getAllThreeAndFour(cg, dag, nonIndThree, nonInd, local);
+    delTriangleInfo(tri_info);
 }
 
 // This function generates all non-induced counts for 5-vertex patterns.
 // It is a wrapper function that calls the main algorithmic parts, and finally
 // calls conversion functions to get induced counts.
 //
-// Input: pointer to CGraph, corresponding DAG, array of non-induced 4-vertex counts, empty array nonInd with 34 entries
-// No output: nonInd will have non-induced counts
-
-void getAllFive(CGraph *cg, CDAG *dag, double (&nonIndFour)[11], double (&nonIndFive)[34])
+// Input: pointer to CGraph, corresponding DAG, array of non-induced 4-vertex counts, empty array nonInd with 34 entries,
+//        the TriangleInfo of dag->outlist (from getAllThree or getAllThreeAndFour, still owned by the caller),
+//        and the mask of 5-vertex counts to compute. nonIndFour needs the counts in fourNeededForFive(mask).
+//        Optionally countedFour, the 64-bit totals of the 4-vertex counters (from getAllFour), which are
+//        used instead of nonIndFour, and counted, an array of 21 entries.
+// No output: nonInd will have non-induced counts, and counted (if given) the 64-bit totals of the counters
+//            of the connected patterns 13 to 33 (0 for those not in mask), for exactFive
+
+void getAllFive(CGraph *cg, CDAG *dag, double (&nonIndFour)[11], double (&nonIndFive)[34], TriangleInfo &tri_info, PatternMask mask = allPatterns,
+                const NoninducedFourCounts *countedFour = NULL, EdgeIdx *counted = NULL)
 {
     double n, m, w, t;
     NoninducedFourCounts nonIndFourStruct;
     SomeFourPatterns four_info;
 
-    nonIndFourStruct.threestars = nonIndFour[5];
-    nonIndFourStruct.threepaths = nonIndFour[6];
-    nonIndFourStruct.tailedtris = nonIndFour[7];
-    nonIndFourStruct.fourcycles = nonIndFour[8];
-    nonIndFourStruct.chordalcycles = nonIndFour[9];
-    nonIndFourStruct.fourcliques = nonIndFour[10];
+    // 4-vertex counts that are not needed may not have been computed, and are left out
+    PatternMask four_mask = fourNeededForFive(mask);
+    auto four = [&](int p) -> EdgeIdx { return hasPattern(four_mask, p) ? nonIndFour[p] : 0; };
+    nonIndFourStruct.threestars = four(5);
+    nonIndFourStruct.threepaths = four(6);
+    nonIndFourStruct.tailedtris = four(7);
+    nonIndFourStruct.fourcycles = four(8);
+    nonIndFourStruct.chordalcycles = four(9);
+    nonIndFourStruct.fourcliques = four(10);
+    if (countedFour)
+        nonIndFourStruct = *countedFour;
 
     four_info.threestars = nonIndFourStruct.threestars;
     four_info.threepaths = nonIndFourStruct.threepaths;
     four_info.tailedtris = nonIndFourStruct.tailedtris;
     four_info.chordalcycles = nonIndFourStruct.chordalcycles;
 
-    printf("Getting all triangles\n");
-    TriangleInfo tri_info = betterWedgeEnumerator(&(dag->outlist));
-    TriangleList allTris = storeAllTriangles(cg, tri_info.total);
-
-    printf("Also getting reverse triangle info\n");
-    TriangleInfo in_tri_info = moveOutToIn(&(dag->outlist), &(dag->inlist), &tri_info);
-
     n = cg->nVertices;
 
     m = 0;
@@ -218,6 +461,91 @@ void getAllFive(CGraph *cg, CDAG *dag, double (&nonIndFour)[11], double (&nonInd
     }
     m = m / 2;
 
+    // The counters below only read the graph and the triangle structures, so they run as a task graph:
+    // each starts as soon as the triangle structures it needs are ready, and they share the thread pool.
+    // Only the counters for patterns in mask are added, along with the triangle structures they need.
+    // Each counter is added with the O(n) scratch sets it holds (one per thread for the parallel ones),
+    // so that the running counters hold about as much scratch as a single parallel one (see TaskGraph).
+    TriangleInfo in_tri_info = TriangleInfo();
+    TriangleList allTris = TriangleList();
+    FiveTrees tree_counts = FiveTrees();
+    FiveFromTriangles tri_based_counts = FiveFromTriangles();
+    Count hourglass = 0, stingray = 0, three_tri_col = 0, tri_strip = 0, cobra = 0;
+    CycleBased cycle_related = CycleBased();
+    CliqueBased clique_related = CliqueBased();
+    EdgeIdx five_cycle = 0, almost_clique = 0;
+    CollisionPatterns collision_vals = CollisionPatterns();
+
+    TaskGraph tasks;
+    const int serial = 1, parallel = numThreads(); // scratch sets held by a counter
+    std::vector<int> all_tris_task, in_tri_task; // dependencies on the triangle structures
+    if (mask & patternBits({25, 29, 30}))
+        all_tris_task.push_back(tasks.add([&]()
+        {
+            allTris = storeAllTriangles(cg, tri_info.total);
+        }));
+    if (mask & patternBits({19, 24}))
+        in_tri_task.push_back(tasks.add([&]()
+        {
+            printf("Also getting reverse triangle info\n");
+            in_tri_info = moveOutToIn(&(dag->outlist), &(dag->inlist), &tri_info);
+        }));
+
+    if (mask & patternBits({13, 14, 15}))
+        tasks.add([&]()
+        {
+            printf("Counting trees\n");
+            tree_counts = fiveTreeCounter(cg, nonIndFourStruct, tri_info.total);
+        }, std::vector<int>(), serial);
+    if (mask & patternBits({16, 17, 18}))
+        tasks.add([&]()
+        {
+            printf("Counting triangle based patterns\n");
+            tri_based_counts = fiveFromTriCounter(cg, &(dag->outlist), &tri_info, four_info);
+        }, std::vector<int>(), serial);
+    if (hasPattern(mask, 21))
+        tasks.add([&]() { hourglass = count5_Hourglass<false>(&(dag->outlist), &tri_info, 0); }, std::vector<int>(), serial);
+    if (hasPattern(mask, 23))
+        tasks.add([&]() { stingray = count5_Stingray<false>(&(dag->outlist), &(dag->inlist), &tri_info, 0); }, std::vector<int>(), serial);
+    if (hasPattern(mask, 26))
+        tasks.add([&]() { three_tri_col = count5_StellateTrident<false>(&(dag->outlist), &tri_info, 0); }, std::vector<int>(), serial);
+    if (hasPattern(mask, 28))
+        tasks.add([&]() { tri_strip = count5_TriangleStrip<true>(&(dag->outlist), nonIndFourStruct.fourcliques, &tri_info); }, std::vector<int>(), serial);
+    if (hasPattern(mask, 22))
+        tasks.add([&]() { cobra = count5_Cobra<true>(&(dag->outlist), &(dag->inlist), nonIndFourStruct.fourcliques); }, std::vector<int>(), serial);
+
+    if (mask & patternBits({19, 24}))
+        tasks.add([&]()
+        {
+            printf("Counting 4-cycle based patterns\n");
+            cycle_related = fourCycleBasedCounter(&(dag->outlist), &(dag->inlist), &tri_info, &in_tri_info, nonIndFourStruct.chordalcycles);
+        }, in_tri_task, serial);
+    if (mask & patternBits({27, 31, 33}))
+        tasks.add([&]()
+        {
+            printf("Counting 4-clique based patterns\n");
+            clique_related = fourCliqueBasedCounter(cg, &(dag->outlist), &tri_info);
+        }, std::vector<int>(), parallel);
+    if (hasPattern(mask, 20))
+        tasks.add([&]()
+        {
+            printf("Counting five cycles\n");
+            five_cycle = fiveCycleCounter(&(dag->outlist), &(dag->inlist));
+        }, std::vector<int>(), parallel);
+    if (mask & patternBits({25, 29, 30}))
+        tasks.add([&]()
+        {
+            printf("Counting collision patterns\n");
+            collision_vals = fromTriangleList(cg, &allTris);
+        }, all_tris_task, parallel);
+    if (hasPattern(mask, 32))
+        tasks.add([&]()
+        {
+            printf("Counting almost cliques\n");
+            almost_clique = almostFiveClique(cg, &(dag->outlist));
+        }, std::vector<int>(), parallel);
+    tasks.run();
+
     t = tri_info.total;
 
     nonIndFive[0] = (n * (n - 1) * (n - 2) * (n - 3) * (n - 4)) / 120;
@@ -227,56 +555,41 @@ void getAllFive(CGraph *cg, CDAG *dag, double (&nonIndFour)[11], double (&nonInd
     nonIndFive[4] = t * ((n - 3) * (n - 4)) / 2;
 
     for (int i = 5; i < 11; i++)
-        nonIndFive[i] = nonIndFour[i] * (n - 4);
+        nonIndFive[i] = four(i) * (n - 4);
 
     nonIndFive[11] = w * (m - 2) - 3 * t - 3 * nonIndFourStruct.threestars - 2 * nonIndFourStruct.threepaths;
     nonIndFive[12] = t * (m - 3) - nonIndFourStruct.tailedtris;
 
-    printf("Counting trees\n");
-    FiveTrees tree_counts = fiveTreeCounter(cg, nonIndFourStruct, tri_info.total);
-
-    printf("Counting triangle based patterns\n");
-    FiveFromTriangles tri_based_counts = fiveFromTriCounter(cg, &(dag->outlist), &tri_info, four_info);
-
-    Count hourglass = count5_Hourglass<false>(&(dag->outlist), &tri_info, 0);
-    Count stingray = count5_Stingray<false>(&(dag->outlist), &(dag->inlist), &tri_info, 0);
-    Count three_tri_col = count5_StellateTrident<false>(&(dag->outlist), &tri_info, 0);
-    Count tri_strip = count5_TriangleStrip<true>(&(dag->outlist), nonIndFourStruct.fourcliques, &tri_info);
-    Count cobra = count5_Cobra<true>(&(dag->outlist), &(dag->inlist), nonIndFourStruct.fourcliques);
-
-    printf("Counting 4-cycle and 4-clique based patterns\n");
-    CycleBased cycle_related = fourCycleBasedCounter(&(dag->outlist), &(dag->inlist), &tri_info, &in_tri_info, nonIndFourStruct.chordalcycles);
-    CliqueBased clique_related = fourCliqueBasedCounter(cg, &(dag->outlist), &tri_info);
-
-    printf("Counting five cycles\n");
-    EdgeIdx five_cycle = fiveCycleCounter(&(dag->outlist), &(dag->inlist));
-
-    printf("Counting collision patterns\n");
-    CollisionPatterns collision_vals = fromTriangleList(cg, &allTris);
-
-    printf("Counting almost cliques\n");
-    EdgeIdx almost_clique = almostFiveClique(cg);
-
-    nonIndFive[13] = tree_counts.fourstars;
-    nonIndFive[14] = tree_counts.prongs;
-    nonIndFive[15] = tree_counts.fourpaths;
-    nonIndFive[16] = tri_based_counts.forktailedtris;
-    nonIndFive[17] = tri_based_counts.longtailedtris;
-    nonIndFive[18] = tri_based_counts.doubletailedtris;
-    nonIndFive[19] = cycle_related.tailedfourcycles;
-    nonIndFive[20] = five_cycle;
-    nonIndFive[21] = hourglass;
-    nonIndFive[22] = cobra;
-    nonIndFive[23] = stingray;
-    nonIndFive[24] = cycle_related.hattedfourcycles;
-    nonIndFive[25] = collision_vals.threeWedgeCol;
-    nonIndFive[26] = three_tri_col;
-    nonIndFive[27] = clique_related.tailedfourcliques;
-    nonIndFive[28] = tri_strip;
-    nonIndFive[29] = collision_vals.chordalWedgeCol;
-    nonIndFive[30] = collision_vals.wheel;
-    nonIndFive[31] = clique_related.hattedfourcliques;
-    nonIndFive[32] = almost_clique;
-    nonIndFive[33] = clique_related.fivecliques;
+    EdgeIdx connected[21] = {tree_counts.fourstars,                   // 13
+                             tree_counts.prongs,                      // 14
+                             tree_counts.fourpaths,                   // 15
+                             tri_based_counts.forktailedtris,         // 16
+                             tri_based_counts.longtailedtris,         // 17
+                             tri_based_counts.doubletailedtris,       // 18
+                             cycle_related.tailedfourcycles,          // 19
+                             five_cycle,                              // 20
+                             hourglass,                               // 21
+                             cobra,                                   // 22
+                             stingray,                                // 23
+                             cycle_related.hattedfourcycles,          // 24
+                             collision_vals.threeWedgeCol,            // 25
+                             three_tri_col,                           // 26
+                             clique_related.tailedfourcliques,        // 27
+                             tri_strip,                               // 28
+                             collision_vals.chordalWedgeCol,          // 29
+                             collision_vals.wheel,                    // 30
+                             clique_related.hattedfourcliques,        // 31
+                             almost_clique,                           // 32
+                             clique_related.fivecliques};             // 33
+    for (int p = 13; p < 34; p++)
+        nonIndFive[p] = connected[p - 13];
+    if (counted)
+        std::copy(connected, connected + 21, counted);
+    for (int p = 0; p < 34; p++)
+        if (!hasPattern(mask, p))
+            nonIndFive[p] = NAN;
+
+    delTriangleInfo(in_tri_info);
+    delTriangleList(allTris);
 }
 #endif
@@ -78,6 +78,10 @@ struct CGraph
 
   CGraph renameByDegreeOrder() const; 
 
+  //Same as above, and also stores the relabeling: mapping[old label] is the
+  //new label. mapping must have length nVertices.
+  CGraph renameByDegreeOrder(VertexIdx *mapping) const;
+
   //Returns the index of the edge v1 -> v2 in the nbor list nbors.
   //Returns invalidEdge if v1 -> v2 does not exist
   EdgeIdx getEdgeBinary(VertexIdx v1, VertexIdx v2) const;
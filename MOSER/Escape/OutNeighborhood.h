@@ -0,0 +1,188 @@
+#ifndef ESCAPE_OUTNEIGHBORHOOD_H_
+#define ESCAPE_OUTNEIGHBORHOOD_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Escape/Graph.h"
+
+using namespace Escape;
+
+// The subgraph of a DAG induced by the out-neighborhood of a single vertex i.
+//
+// In the degree-ordered DAG, out-degrees are small (at most about sqrt(2m)), so
+// cliques containing i as their lowest vertex can be found entirely inside this
+// small subgraph. The out-neighbors of i are given local ids 0,...,size-1 in the
+// order they appear in gout (so local ids are sorted whenever gout is sorted by ID),
+// and the edges between them are stored both as local out-lists and, for
+// neighborhoods of at most bitmapLimit vertices, as rows of a bitmap. Common
+// neighbors of two local vertices are then a word-level AND of their rows.
+//
+// One OutNeighborhood is scratch for one thread. It is filled for a vertex with
+// loadOutNeighborhood, which also clears whatever was loaded before.
+
+const VertexIdx bitmapLimit = 4096; // largest neighborhood that gets a bitmap (2MB of rows)
+
+struct OutNeighborhood
+{
+    VertexIdx center;               // the vertex i whose out-neighborhood is loaded, -1 if none
+    VertexIdx size;                 // number of out-neighbors of center, i.e. local vertices
+    const VertexIdx *vertices;      // local id -> vertex in gout
+    EdgeIdx firstEdge;              // index in gout->nbors of the edge (center, vertices[0])
+    VertexIdx *local;               // vertex in gout -> local id + 1, and 0 for vertices outside (length gout->nVertices)
+
+    std::vector<EdgeIdx> offsets;   // local vertex a has out-neighbors nbors[offsets[a]], ..., nbors[offsets[a+1]-1]
+    std::vector<VertexIdx> nbors;   // local ids
+    std::vector<EdgeIdx> edges;     // edges[p] is the index in gout->nbors of the edge stored in nbors[p]
+
+    VertexIdx words;                // 64-bit words per bitmap row, and 0 if no bitmap was built
+    std::vector<uint64_t> bits;     // row of local vertex a is bits[a*words], ..., bits[(a+1)*words-1]
+};
+
+OutNeighborhood newOutNeighborhood(const CGraph *gout)
+{
+    OutNeighborhood ret;
+    ret.center = -1;
+    ret.size = 0;
+    ret.vertices = NULL;
+    ret.firstEdge = 0;
+    ret.local = new VertexIdx[gout->nVertices+1];
+    for (VertexIdx v=0; v <= gout->nVertices; v++)
+        ret.local[v] = 0;
+    ret.words = 0;
+    return ret;
+}
+
+void delOutNeighborhood(OutNeighborhood &nb)
+{
+    delete[] nb.local;
+}
+
+// Loads the out-neighborhood of i in gout into nb.
+void loadOutNeighborhood(const CGraph *gout, VertexIdx i, OutNeighborhood &nb)
+{
+    for (VertexIdx a=0; a < nb.size; a++) // clear the previous neighborhood
+        nb.local[nb.vertices[a]] = 0;
+
+    nb.center = i;
+    nb.size = gout->offsets[i+1] - gout->offsets[i];
+    nb.vertices = gout->nbors + gout->offsets[i];
+    nb.firstEdge = gout->offsets[i];
+    for (VertexIdx a=0; a < nb.size; a++)
+        nb.local[nb.vertices[a]] = a+1;
+
+    nb.words = 0;
+    if (nb.size <= bitmapLimit)
+    {
+        nb.words = (nb.size + 63)/64;
+        nb.bits.assign(nb.size*nb.words, 0);
+    }
+
+    nb.offsets.resize(nb.size+1);
+    nb.nbors.clear();
+    nb.edges.clear();
+    nb.offsets[0] = 0;
+    for (VertexIdx a=0; a < nb.size; a++)
+    {
+        VertexIdx u = nb.vertices[a];
+        for (EdgeIdx pos = gout->offsets[u]; pos < gout->offsets[u+1]; pos++) // loop over out-neighbors of u, keeping those in the neighborhood
+        {
+            VertexIdx b = nb.local[gout->nbors[pos]];
+            if (b == 0)
+                continue;
+            b--;
+            nb.nbors.push_back(b);
+            nb.edges.push_back(pos);
+            if (nb.words)
+                nb.bits[a*nb.words + b/64] |= ((uint64_t) 1) << (b%64);
+        }
+        nb.offsets[a+1] = nb.nbors.size();
+    }
+}
+
+// Returns true if there is an edge from local vertex a to local vertex b.
+bool isLocalEdge(const OutNeighborhood &nb, VertexIdx a, VertexIdx b)
+{
+    if (nb.words)
+        return (nb.bits[a*nb.words + b/64] >> (b%64)) & 1;
+    return std::binary_search(nb.nbors.begin() + nb.offsets[a], nb.nbors.begin() + nb.offsets[a+1], b);
+}
+
+// Returns the number of common out-neighbors of local vertices a and b.
+// Requires gout to be sorted by ID, when no bitmap was built.
+EdgeIdx countLocalCommon(const OutNeighborhood &nb, VertexIdx a, VertexIdx b)
+{
+    EdgeIdx ret = 0;
+    if (nb.words)
+    {
+        const uint64_t *rowa = &nb.bits[a*nb.words];
+        const uint64_t *rowb = &nb.bits[b*nb.words];
+        for (VertexIdx w=0; w < nb.words; w++)
+            ret += __builtin_popcountll(rowa[w] & rowb[w]);
+        return ret;
+    }
+
+    // no bitmap: merge the two sorted out-lists
+    EdgeIdx pa = nb.offsets[a], enda = nb.offsets[a+1];
+    EdgeIdx pb = nb.offsets[b], endb = nb.offsets[b+1];
+    while (pa < enda && pb < endb)
+    {
+        VertexIdx x = nb.nbors[pa], y = nb.nbors[pb];
+        ret += (x == y);
+        pa += (x <= y);
+        pb += (y <= x);
+    }
+    return ret;
+}
+
+// Returns the number of common out-neighbors of local vertices a, b and c.
+// Requires gout to be sorted by ID, when no bitmap was built.
+EdgeIdx countLocalCommon(const OutNeighborhood &nb, VertexIdx a, VertexIdx b, VertexIdx c)
+{
+    EdgeIdx ret = 0;
+    if (nb.words)
+    {
+        const uint64_t *rowa = &nb.bits[a*nb.words];
+        const uint64_t *rowb = &nb.bits[b*nb.words];
+        const uint64_t *rowc = &nb.bits[c*nb.words];
+        for (VertexIdx w=0; w < nb.words; w++)
+            ret += __builtin_popcountll(rowa[w] & rowb[w] & rowc[w]);
+        return ret;
+    }
+
+    // no bitmap: merge the three sorted out-lists
+    EdgeIdx pa = nb.offsets[a], enda = nb.offsets[a+1];
+    EdgeIdx pb = nb.offsets[b], endb = nb.offsets[b+1];
+    EdgeIdx pc = nb.offsets[c], endc = nb.offsets[c+1];
+    while (pa < enda && pb < endb && pc < endc)
+    {
+        VertexIdx x = nb.nbors[pa], y = nb.nbors[pb], z = nb.nbors[pc];
+        VertexIdx low = std::min(x, std::min(y, z));
+        ret += (x == y && y == z);
+        pa += (x == low);
+        pb += (y == low);
+        pc += (z == low);
+    }
+    return ret;
+}
+
+// Calls fn(c, posac, posbc) for every common out-neighbor c of local vertices a and b,
+// in increasing order of c. posac and posbc are the positions of (a,c) and (b,c) in the
+// local out-lists (so nb.edges[posac] is the edge in gout). Requires gout to be sorted by ID.
+template <typename F>
+void forEachLocalCommon(const OutNeighborhood &nb, VertexIdx a, VertexIdx b, F fn)
+{
+    EdgeIdx pa = nb.offsets[a], enda = nb.offsets[a+1];
+    EdgeIdx pb = nb.offsets[b], endb = nb.offsets[b+1];
+    while (pa < enda && pb < endb)
+    {
+        VertexIdx x = nb.nbors[pa], y = nb.nbors[pb];
+        if (x == y)
+            fn(x, pa, pb);
+        pa += (x <= y);
+        pb += (y <= x);
+    }
+}
+
+#endif
@@ -0,0 +1,422 @@
+#ifndef ESCAPE_PARALLEL_H_
+#define ESCAPE_PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "Escape/Graph.h"
+
+namespace Escape
+{
+
+// Small helpers for running the counting kernels on several threads. The
+// kernels only read the (immutable) graph structures, and every thread gets
+// its own scratch arrays, so the helpers below only need to hand out work to a
+// shared pool of threads.
+//
+// The number of threads defaults to the hardware concurrency. It can be
+// overridden with the ESCAPE_NUM_THREADS environment variable, or by calling
+// setNumThreads before counting.
+
+inline int &numThreadsSetting()
+{
+    static int nthreads = 0; // 0 means "not decided yet"
+    return nthreads;
+}
+
+// The kernels allocate and free their O(n) scratch arrays on whichever thread runs
+// them. After such a free glibc raises its mmap and trim thresholds, and from then on
+// keeps freed arrays in the arena of the freeing thread, so every thread would hold on
+// to its own copies. Fixed (default) thresholds keep large arrays mmapped, and returned
+// on free. Called before the kernels allocate anything for more than one thread.
+inline void releaseScratchOnFree(int nthreads)
+{
+#ifdef __GLIBC__
+    if (nthreads > 1)
+    {
+        mallopt(M_MMAP_THRESHOLD, 128 * 1024);
+        mallopt(M_TRIM_THRESHOLD, 128 * 1024);
+    }
+#endif
+}
+
+inline int numThreads()
+{
+    int &nthreads = numThreadsSetting();
+    if (nthreads <= 0)
+    {
+        const char *env = getenv("ESCAPE_NUM_THREADS");
+        if (env != NULL)
+            nthreads = atoi(env);
+        if (nthreads <= 0)
+            nthreads = std::thread::hardware_concurrency();
+        if (nthreads <= 0)
+            nthreads = 1;
+        releaseScratchOnFree(nthreads);
+    }
+    return nthreads;
+}
+
+inline void setNumThreads(int nthreads)
+{
+    numThreadsSetting() = nthreads;
+    releaseScratchOnFree(nthreads);
+}
+
+// A counter on its own cache line. Per-thread partial sums are kept in arrays
+// of these, so that threads updating neighboring entries do not contend.
+struct PaddedCount
+{
+    Count value;
+    char pad[64 - sizeof(Count)];
+};
+
+// Adds val to *addr. Used for per-vertex and per-edge counts that several
+// threads contribute to.
+inline void atomicAdd(Count *addr, Count val)
+{
+    if (val != 0)
+        __atomic_fetch_add(addr, val, __ATOMIC_RELAXED);
+}
+
+// A pool of worker threads shared by all parallel loops and tasks. Work is posted as
+// jobs with a number of slots, and every slot runs once, on whichever thread claims it.
+// Idle workers claim free slots of the oldest posted job, so workers that are done with
+// one counter join the parallel loops of the counters that are still running.
+//
+// The pool has numThreads()-1 workers (decided at first use), and the threads that post
+// jobs take part as well. A thread waiting for its own job claims that job's remaining
+// slots itself, so a job always completes, however busy the workers are.
+class ThreadPool
+{
+public:
+    static ThreadPool &instance()
+    {
+        static ThreadPool pool(numThreads() - 1);
+        return pool;
+    }
+
+    // Runs fn(slot) for slot = 0,...,slots-1, and waits for all of them.
+    // The calling thread runs slot 0.
+    void run(int slots, const std::function<void(int)> &fn)
+    {
+        std::shared_ptr<Job> job = std::make_shared<Job>(fn, slots);
+        job->next = 1; // slot 0 is taken by the caller
+        if (slots > 1)
+            post(job);
+        runSlot(job, 0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (job->finished < job->slots)
+        {
+            if (job->next < job->slots) // nobody picked these up, run them here
+            {
+                int slot = claim(job);
+                lock.unlock();
+                runSlot(job, slot);
+                lock.lock();
+            }
+            else
+                changed.wait(lock);
+        }
+    }
+
+    // Posts fn as a job of one slot, and returns without waiting for it.
+    void post(const std::function<void(int)> &fn)
+    {
+        post(std::make_shared<Job>(fn, 1));
+    }
+
+    // Runs slots of posted jobs on the calling thread, until done() is true.
+    // done is checked with the pool locked, after every slot that finishes anywhere.
+    template <typename F>
+    void helpUntil(F done)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!done())
+        {
+            if (!jobs.empty())
+            {
+                std::shared_ptr<Job> job = jobs.front();
+                int slot = claim(job);
+                lock.unlock();
+                runSlot(job, slot);
+                lock.lock();
+            }
+            else
+                changed.wait(lock);
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        for (auto &w : workers)
+            w.join();
+    }
+
+private:
+    struct Job
+    {
+        std::function<void(int)> fn;
+        int slots;
+        int next;       // first slot not claimed yet
+        int finished;   // number of slots that have finished
+
+        Job(const std::function<void(int)> &fn, int slots) : fn(fn), slots(slots), next(0), finished(0) {}
+    };
+
+    std::mutex mutex;                           // guards everything below, and next/finished of every job
+    std::condition_variable changed;            // a job was posted, a slot finished, or the pool is stopping
+    std::deque<std::shared_ptr<Job> > jobs;     // posted jobs that still have unclaimed slots, oldest first
+    std::vector<std::thread> workers;
+    bool stopping;
+
+    explicit ThreadPool(int nworkers) : stopping(false)
+    {
+        for (int t = 0; t < nworkers; ++t)
+            workers.emplace_back([this]() { work(); });
+    }
+
+    void post(const std::shared_ptr<Job> &job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+        }
+        changed.notify_all();
+    }
+
+    // Claims the next slot of job. Requires the pool to be locked and job to have a free slot.
+    int claim(const std::shared_ptr<Job> &job)
+    {
+        int slot = job->next++;
+        if (job->next == job->slots)
+        {
+            auto it = std::find(jobs.begin(), jobs.end(), job);
+            if (it != jobs.end())
+                jobs.erase(it);
+        }
+        return slot;
+    }
+
+    void runSlot(const std::shared_ptr<Job> &job, int slot)
+    {
+        job->fn(slot);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job->finished++;
+        }
+        changed.notify_all();
+    }
+
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping)
+        {
+            if (jobs.empty())
+            {
+                changed.wait(lock);
+                continue;
+            }
+            std::shared_ptr<Job> job = jobs.front();
+            int slot = claim(job);
+            lock.unlock();
+            runSlot(job, slot);
+            lock.lock();
+        }
+    }
+};
+
+// Runs fn(tid) for tid = 0,...,nthreads-1 on the thread pool, and waits for all of
+// them. Thread 0 is the calling thread, so nthreads == 1 does not involve the pool.
+// Each tid runs exactly once, but several tids may run one after the other on the
+// same thread, so fn must not wait for other tids.
+template <typename F>
+void parallelRun(int nthreads, F fn)
+{
+    if (nthreads <= 1)
+    {
+        fn(0);
+        return;
+    }
+    ThreadPool::instance().run(nthreads, std::function<void(int)>(fn));
+}
+
+// A set of tasks with dependencies, run concurrently on the thread pool. A task is
+// posted to the pool as soon as all tasks it depends on have finished. Tasks may use
+// the parallel loops below, whose free slots are picked up by idle workers, so the
+// long-running tasks get the whole pool once the short ones are done.
+//
+// Most tasks allocate O(n) scratch arrays: one set if they are serial, numThreads()
+// sets if they use the parallel loops. Running all of them at once would multiply
+// the memory, so each task is added with the number of sets it holds, and the tasks
+// running at the same time hold at most numThreads() sets (what a single parallel
+// task holds). A ready task that does not fit waits for running ones to finish, in
+// the order the tasks became ready. So a parallel task runs alone, and the serial
+// ones run side by side.
+class TaskGraph
+{
+public:
+    TaskGraph() : budget(numThreads()), used(0) {}
+
+    // Adds a task that runs after all tasks in deps (ids returned by earlier calls to add),
+    // and holds scratch sets of O(n) scratch while it runs.
+    int add(const std::function<void()> &fn, const std::vector<int> &deps = std::vector<int>(), int scratch = 0)
+    {
+        int id = tasks.size();
+        tasks.push_back(Task{fn, std::vector<int>(), (int) deps.size(), std::min(scratch, budget)});
+        for (int d : deps)
+            tasks[d].successors.push_back(id);
+        return id;
+    }
+
+    // Runs all tasks, and returns when they have all finished. A TaskGraph is run only once.
+    void run()
+    {
+        // collect the tasks without dependencies before posting any, since
+        // finished tasks post their successors as soon as they are ready
+        std::vector<int> ready;
+        for (size_t id = 0; id < tasks.size(); ++id)
+            if (tasks[id].waiting == 0)
+                ready.push_back(id);
+
+        remaining = tasks.size();
+        start(ready);
+        ThreadPool::instance().helpUntil([this]() { return remaining == 0; });
+    }
+
+private:
+    struct Task
+    {
+        std::function<void()> fn;
+        std::vector<int> successors;
+        int waiting;    // number of unfinished tasks this one depends on
+        int scratch;    // number of O(n) scratch sets it holds, at most budget
+    };
+
+    std::vector<Task> tasks;
+    int budget;                     // number of scratch sets the running tasks may hold
+    std::mutex mutex;               // guards waiting of every task, used and queued
+    int used;                       // scratch sets held by the running tasks
+    std::deque<int> queued;         // ready tasks that did not fit in the budget
+    std::atomic<size_t> remaining;  // number of unfinished tasks
+
+    // Queues the ready tasks, and posts the queued ones that fit in the budget.
+    // Called with mutex unlocked.
+    void start(const std::vector<int> &ready)
+    {
+        std::vector<int> fit;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued.insert(queued.end(), ready.begin(), ready.end());
+            takeFitting(fit);
+        }
+        for (int id : fit)
+            post(id);
+    }
+
+    // Moves the tasks at the front of queued that fit in the budget to fit.
+    // The first one that does not fit stops the others, so no task waits forever.
+    void takeFitting(std::vector<int> &fit)
+    {
+        while (!queued.empty() && used + tasks[queued.front()].scratch <= budget)
+        {
+            used += tasks[queued.front()].scratch;
+            fit.push_back(queued.front());
+            queued.pop_front();
+        }
+    }
+
+    void post(int id)
+    {
+        ThreadPool::instance().post([this, id](int)
+        {
+            tasks[id].fn();
+            std::vector<int> fit;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                used -= tasks[id].scratch;
+                for (int succ : tasks[id].successors)
+                    if (--tasks[succ].waiting == 0)
+                        queued.push_back(succ);
+                takeFitting(fit);
+            }
+            for (int next : fit)
+                post(next);
+            remaining--;
+        });
+    }
+};
+
+// Runs fn(tid, v) for every v in [begin, end). The range is handed out in
+// chunks of grain consecutive indices, on demand, so threads that finish early
+// pick up the remaining work.
+template <typename F>
+void parallelFor(EdgeIdx begin, EdgeIdx end, EdgeIdx grain, int nthreads, F fn)
+{
+    std::atomic<EdgeIdx> next(begin);
+    grain = std::max<EdgeIdx>(grain, 1);
+    parallelRun(nthreads, [&](int tid)
+    {
+        for (EdgeIdx lo = next.fetch_add(grain); lo < end; lo = next.fetch_add(grain))
+            for (EdgeIdx v = lo; v < std::min(lo + grain, end); ++v)
+                fn(tid, v);
+    });
+}
+
+// Runs fn(tid, v) for every vertex v in [0, n), where work[v] is an estimate
+// of the cost of v (e.g. the number of wedges it generates). The vertices are
+// cut into contiguous blocks of roughly equal total work (about 16 per thread),
+// and the blocks are handed out dynamically. Contiguous blocks keep the access
+// pattern of the serial loop, while the work estimate keeps a block of
+// high-degree vertices from becoming the long tail.
+template <typename F>
+void parallelForWeighted(VertexIdx n, const EdgeIdx *work, int nthreads, F fn)
+{
+    EdgeIdx total = 0;
+    for (VertexIdx v = 0; v < n; ++v)
+        total += work[v] + 1; // +1 so that vertices without work still cost something
+
+    EdgeIdx target = total / (16 * (EdgeIdx) nthreads) + 1; // desired work per block
+    std::vector<VertexIdx> cuts(1, 0); // blocks are [cuts[b], cuts[b+1])
+    EdgeIdx acc = 0;
+    for (VertexIdx v = 0; v < n; ++v)
+    {
+        acc += work[v] + 1;
+        if (acc >= target)
+        {
+            cuts.push_back(v + 1);
+            acc = 0;
+        }
+    }
+    if (cuts.back() != n)
+        cuts.push_back(n);
+
+    std::atomic<size_t> next(0);
+    parallelRun(nthreads, [&](int tid)
+    {
+        for (size_t b = next++; b + 1 < cuts.size(); b = next++)
+            for (VertexIdx v = cuts[b]; v < cuts[b + 1]; ++v)
+                fn(tid, v);
+    });
+}
+
+}
+#endif
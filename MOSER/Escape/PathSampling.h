@@ -0,0 +1,427 @@
+#ifndef ESCAPE_PATHSAMPLING_H_
+#define ESCAPE_PATHSAMPLING_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Escape/Graph.h"
+#include "Escape/Digraph.h"
+#include "Escape/Conversion.h"
+#include "Escape/Parallel.h"
+#include "Escape/Random.h"
+
+using namespace Escape;
+
+// Estimates of the non-induced 4-vertex and 5-vertex counts, for graphs where exact counting
+// takes too long. This is the path sampling of "Path Sampling: A Fast and Provable Method for
+// Estimating 4-Vertex Subgraph Counts" (http://arxiv.org/pdf/1411.4942v1.pdf): paths are sampled
+// uniformly at random, and the frequency of the pattern induced by the vertices of the path is
+// scaled by the number of paths in the graph, divided by the number of paths in the pattern.
+// This gives unbiased estimates of the induced counts of all patterns that contain the path,
+// and the non-induced counts are combinations of these (given by the IndToNon matrices).
+//
+// There are three samplers. Each picks uniformly from a set of tuples of vertices:
+//  - 3-paths: tuples (u', u, v, v') for an edge (u,v) of the DAG, u' a neighbor of u other than v,
+//    and v' a neighbor of v other than u. The tuples with u' == v' are the triangles (3 times each),
+//    and the others the 3-paths (once each). These cover the connected 4-vertex patterns but the 3-star.
+//  - 4-paths: tuples (a, b, c, d, e) for a vertex c, two different neighbors b and d of c, a neighbor a of b
+//    and a neighbor e of d (both other than c). Every 4-path is two of these tuples. These cover the
+//    connected 5-vertex patterns that have a path through all their vertices.
+//  - prongs: tuples (a, b, c, {x, y}) for a vertex c, three different neighbors b, x and y of c and a
+//    neighbor a of b other than c. Every prong is one of these tuples. These cover the two connected
+//    5-vertex patterns without a path through all vertices, besides the 4-star: the prong and the forktailed triangle.
+// 3-stars and 4-stars are counted exactly from the degrees.
+//
+// Edges between the sampled vertices are looked up in the degree-ordered DAG, whose out-lists are short.
+
+// Outcomes of a sample are pattern numbers, as in nonInd. Samples that are not a path (or prong) have
+// the outcome rejectedSample, and the 3-path tuples that are triangles the outcome triangleSample.
+const int triangleSample = 11;
+const int rejectedSample = 34;
+
+// Returns the pattern induced by the k vertices in v (which must be connected in g).
+int classifyPattern(const CGraph *gout, const VertexIdx *v, int k)
+{
+    int deg[5] = {0, 0, 0, 0, 0};
+    bool adj[5][5];
+    for (int a = 0; a < k; a++)
+        for (int b = a+1; b < k; b++)
+        {
+            adj[a][b] = adj[b][a] = gout->isEdgeBinary(v[a], v[b]) || gout->isEdgeBinary(v[b], v[a]);
+            deg[a] += adj[a][b];
+            deg[b] += adj[a][b];
+        }
+
+    std::sort(deg, deg+5); // for k == 4, deg[4] is 0 and becomes a leading zero
+    int degrees = 0;
+    for (int a = 0; a < 5; a++)
+        degrees = 10*degrees + deg[a];
+
+    if (k == 4)
+    {
+        for (int p = 0; p < 6; p++)
+            if (FourPatternDegrees[p][1] == degrees)
+                return FourPatternDegrees[p][0];
+        return rejectedSample;
+    }
+
+    int triangles = 0;
+    for (int a = 0; a < k; a++)
+        for (int b = a+1; b < k; b++)
+            for (int c = b+1; c < k; c++)
+                triangles += adj[a][b] && adj[a][c] && adj[b][c];
+    for (int p = 0; p < 21; p++)
+        if (FivePatternDegrees[p][1] == degrees && FivePatternDegrees[p][2] == triangles)
+            return FivePatternDegrees[p][0];
+    return rejectedSample;
+}
+
+// The tables the samplers draw from. g and gout are the graph and its degree-ordered DAG, both sorted by ID.
+struct PathSampler
+{
+    const CGraph *g;
+    const CGraph *gout;
+    std::vector<EdgeIdx> nborWeight;    // nborWeight[pos] is the sum of deg(b)-1 over neighbors b of i up to pos, in the list of i in g
+    std::vector<double> threePaths;     // prefix sums of the 3-path tuples, over the edges of gout
+    std::vector<double> fourPaths;      // prefix sums of the 4-path tuples, over the centers c
+    std::vector<double> prongs;         // prefix sums of the prong tuples, over the centers c
+};
+
+PathSampler newPathSampler(const CGraph *g, const CGraph *gout)
+{
+    PathSampler ret;
+    ret.g = g;
+    ret.gout = gout;
+    ret.nborWeight.resize(g->nEdges);
+    ret.threePaths.resize(gout->nEdges);
+    ret.fourPaths.resize(g->nVertices);
+    ret.prongs.resize(g->nVertices);
+
+    double three = 0, four = 0, prong = 0;
+    for (VertexIdx c = 0; c < g->nVertices; c++)
+    {
+        EdgeIdx degc = g->offsets[c+1] - g->offsets[c];
+        EdgeIdx sum = 0;
+        double squares = 0;
+        for (EdgeIdx pos = g->offsets[c]; pos < g->offsets[c+1]; pos++)
+        {
+            VertexIdx b = g->nbors[pos];
+            EdgeIdx w = g->offsets[b+1] - g->offsets[b] - 1;
+            sum += w;
+            squares += (double) w * w;
+            ret.nborWeight[pos] = sum;
+        }
+        four += (double) sum * sum - squares;
+        prong += (double) ((degc-1)*(degc-2)/2) * sum;
+        ret.fourPaths[c] = four;
+        ret.prongs[c] = prong;
+
+        for (EdgeIdx pos = gout->offsets[c]; pos < gout->offsets[c+1]; pos++)
+        {
+            VertexIdx v = gout->nbors[pos];
+            three += (double) (degc-1) * (g->offsets[v+1] - g->offsets[v] - 1);
+            ret.threePaths[pos] = three;
+        }
+    }
+    return ret;
+}
+
+// Returns the index i with prefix[i-1] <= r < prefix[i], for r uniform in [0, prefix.back()).
+EdgeIdx samplePrefix(const double *prefix, EdgeIdx n, Rng &rng)
+{
+    double r = rng.uniform() * prefix[n-1];
+    return std::min<EdgeIdx>(std::upper_bound(prefix, prefix+n, r) - prefix, n-1);
+}
+
+// Returns the position (in g->nbors) of a neighbor b of c, picked with probability proportional to deg(b)-1.
+EdgeIdx sampleWeightedNbor(const PathSampler &s, VertexIdx c, Rng &rng)
+{
+    const EdgeIdx *begin = s.nborWeight.data() + s.g->offsets[c];
+    const EdgeIdx *end = s.nborWeight.data() + s.g->offsets[c+1];
+    EdgeIdx r = rng.below(end[-1]);
+    return s.g->offsets[c] + (std::upper_bound(begin, end, r) - begin);
+}
+
+// Returns a uniformly random neighbor of u other than v (u must have degree at least 2).
+// Position k < deg(u)-1 stands for itself, except that the position of v stands for the last one.
+VertexIdx sampleOtherNbor(const CGraph *g, VertexIdx u, VertexIdx v, Rng &rng)
+{
+    EdgeIdx degu = g->offsets[u+1] - g->offsets[u];
+    VertexIdx ret = g->nbors[g->offsets[u] + rng.below(degu-1)];
+    return ret == v ? g->nbors[g->offsets[u+1]-1] : ret;
+}
+
+int sampleThreePath(const PathSampler &s, Rng &rng)
+{
+    const CGraph *gout = s.gout;
+    EdgeIdx pos = samplePrefix(s.threePaths.data(), gout->nEdges, rng);
+    VertexIdx u = std::upper_bound(gout->offsets, gout->offsets+gout->nVertices+1, pos) - gout->offsets - 1;
+    VertexIdx v = gout->nbors[pos];
+
+    VertexIdx path[4] = {sampleOtherNbor(s.g, u, v, rng), u, v, sampleOtherNbor(s.g, v, u, rng)};
+    if (path[0] == path[3])
+        return triangleSample;
+    return classifyPattern(gout, path, 4);
+}
+
+int sampleFourPath(const PathSampler &s, Rng &rng)
+{
+    const CGraph *g = s.g;
+    VertexIdx c = samplePrefix(s.fourPaths.data(), g->nVertices, rng);
+    EdgeIdx posb, posd;
+    do // b and d are picked independently, so the pair (b,d) is proportional to (deg(b)-1)(deg(d)-1)
+    {
+        posb = sampleWeightedNbor(s, c, rng);
+        posd = sampleWeightedNbor(s, c, rng);
+    } while (posb == posd);
+    VertexIdx b = g->nbors[posb], d = g->nbors[posd];
+
+    VertexIdx path[5] = {sampleOtherNbor(g, b, c, rng), b, c, d, sampleOtherNbor(g, d, c, rng)};
+    if (path[0] == d || path[4] == b || path[0] == path[4])
+        return rejectedSample;
+    return classifyPattern(s.gout, path, 5);
+}
+
+int sampleProng(const PathSampler &s, Rng &rng)
+{
+    const CGraph *g = s.g;
+    VertexIdx c = samplePrefix(s.prongs.data(), g->nVertices, rng);
+    EdgeIdx posb = sampleWeightedNbor(s, c, rng);
+    VertexIdx b = g->nbors[posb];
+
+    // two different neighbors of c other than b, with the position of b standing for the last one
+    EdgeIdx degc = g->offsets[c+1] - g->offsets[c];
+    EdgeIdx kx = rng.below(degc-1);
+    EdgeIdx ky = rng.below(degc-2);
+    ky += (ky >= kx);
+    EdgeIdx posx = g->offsets[c] + kx, posy = g->offsets[c] + ky;
+    if (posx == posb)
+        posx = g->offsets[c+1]-1;
+    if (posy == posb)
+        posy = g->offsets[c+1]-1;
+
+    VertexIdx prong[5] = {sampleOtherNbor(g, b, c, rng), b, c, g->nbors[posx], g->nbors[posy]};
+    if (prong[0] == prong[3] || prong[0] == prong[4])
+        return rejectedSample;
+    return classifyPattern(s.gout, prong, 5);
+}
+
+// The outcomes of the samples drawn so far, for one sampler
+struct SampleCounts
+{
+    double total;               // number of tuples the sampler picks from
+    Count samples;              // number of samples
+    std::vector<Count> hits;    // hits[o] is the number of samples with outcome o
+};
+
+// An estimate of the form constant + sum over samplers s of total_s * (mean of coef[s][o] over the sampled outcomes o).
+// Since the samples are independent, its variance is the sum over samplers of total_s^2 * (variance of coef[s][o]) / samples_s.
+struct LinearEstimate
+{
+    double constant;
+    std::vector<double> coef[3];
+};
+
+void evaluateEstimate(const LinearEstimate &e, const SampleCounts *counts, double &value, double &variance)
+{
+    value = e.constant;
+    variance = 0;
+    for (int s = 0; s < 3; s++)
+    {
+        if (e.coef[s].empty() || counts[s].samples == 0)
+            continue;
+        double mean = 0, square = 0, k = counts[s].samples;
+        for (size_t o = 0; o < e.coef[s].size(); o++)
+        {
+            mean += e.coef[s][o]*counts[s].hits[o]/k;
+            square += e.coef[s][o]*e.coef[s][o]*counts[s].hits[o]/k;
+        }
+        value += counts[s].total*mean;
+        variance += counts[s].total*counts[s].total*std::max(square - mean*mean, 0.0)/k;
+    }
+}
+
+// Estimates of the non-induced counts, in the layout of getAllThreeAndFour and getAllFive, with their variances.
+// Counts that are computed exactly have variance 0. The 5-vertex entries are only filled if they were asked for.
+struct PatternEstimates
+{
+    double nonIndThree[4], nonIndFour[11], nonIndFive[34];
+    double varThree[4], varFour[11], varFive[34];
+    Count samples;              // number of samples taken by each sampler
+    double relErr;              // largest relative error (half-width of the 95% confidence interval, over the estimate)
+};
+
+// Estimates the non-induced counts of patterns with up to size (4 or 5) vertices, by path sampling.
+// Samples are drawn in rounds of doubling size, until the 95% confidence interval of every count that
+// was sampled at all is within relErr of the count, or maxSamples samples were drawn by each sampler.
+// Patterns that were never sampled are estimated as 0. The samples only depend on seed and numThreads()
+// (the draws go through Rng, so they are the same on every platform).
+//
+// Input: pointer to CGraph, corresponding DAG, both sorted by ID
+
+PatternEstimates estimateCounts(CGraph *cg, CDAG *dag, int size, double relErr, Count maxSamples, uint64_t seed)
+{
+    PatternEstimates ret;
+    int nthreads = numThreads();
+    double n = cg->nVertices, m = cg->nEdges/2, w = 0, stars3 = 0, stars4 = 0;
+    for (VertexIdx i = 0; i < cg->nVertices; i++)
+    {
+        double deg = cg->offsets[i+1] - cg->offsets[i];
+        w += deg*(deg-1)/2;
+        stars3 += deg*(deg-1)*(deg-2)/6;
+        stars4 += deg*(deg-1)*(deg-2)*(deg-3)/24;
+    }
+
+    printf("Setting up samplers\n");
+    PathSampler sampler = newPathSampler(cg, &(dag->outlist));
+    int nsamplers = (size == 5) ? 3 : 1;
+    SampleCounts counts[3];
+    counts[0].total = sampler.threePaths.empty() ? 0 : sampler.threePaths.back();
+    counts[1].total = sampler.fourPaths.empty() ? 0 : sampler.fourPaths.back();
+    counts[2].total = sampler.prongs.empty() ? 0 : sampler.prongs.back();
+    for (int s = 0; s < 3; s++)
+    {
+        counts[s].samples = 0;
+        counts[s].hits.assign(rejectedSample+1, 0);
+    }
+
+    // the estimates, as combinations of the sampled outcomes. ind4[p] and ind5[p] are unbiased estimates of the
+    // induced counts of p, from the sampler that covers p (or empty, for the stars).
+    LinearEstimate zero = {0, {}};
+    LinearEstimate tri = zero, ind4[11], ind5[34], four[11], five[34], three[4];
+    tri.coef[0].assign(rejectedSample+1, 0);
+    tri.coef[0][triangleSample] = 1.0/3;
+    for (int p = 0; p < 11; p++)
+    {
+        ind4[p] = zero;
+        if (p > 5)
+        {
+            ind4[p].coef[0].assign(rejectedSample+1, 0);
+            ind4[p].coef[0][p] = 1.0/FourIndToNonMatrix[6][p]; // number of 3-paths in p
+        }
+    }
+    for (int p = 0; p < 34; p++)
+    {
+        ind5[p] = zero;
+        if (p == 14 || p == 16)
+        {
+            ind5[p].coef[2].assign(rejectedSample+1, 0);
+            ind5[p].coef[2][p] = 1.0/FiveIndToNonMatrix[14][p]; // number of prongs in p
+        }
+        else if (p > 13)
+        {
+            ind5[p].coef[1].assign(rejectedSample+1, 0);
+            ind5[p].coef[1][p] = 0.5/FiveIndToNonMatrix[15][p]; // number of 4-paths in p, and each is sampled twice
+        }
+    }
+
+    // adds factor*e to sum
+    auto add = [](LinearEstimate &sum, const LinearEstimate &e, double factor)
+    {
+        sum.constant += factor*e.constant;
+        for (int s = 0; s < 3; s++)
+        {
+            if (e.coef[s].empty())
+                continue;
+            sum.coef[s].resize(rejectedSample+1, 0);
+            for (int o = 0; o <= rejectedSample; o++)
+                sum.coef[s][o] += factor*e.coef[s][o];
+        }
+    };
+
+    for (int i = 0; i < 4; i++)
+        three[i] = zero;
+    three[0].constant = (n * (n - 1) * (n - 2)) / 6;
+    three[1].constant = m * (n - 2);
+    three[2].constant = w;
+    add(three[3], tri, 1);
+
+    for (int q = 0; q < 11; q++)
+        four[q] = zero;
+    four[0].constant = (n * (n - 1) * (n - 2) * (n - 3)) / 24;
+    four[1].constant = m * ((n - 2) * (n - 3) / 2);
+    four[2].constant = (m * (m - 1) / 2) - w;
+    four[3].constant = w * (n - 3);
+    add(four[4], tri, n - 3);
+    four[5].constant = stars3;
+    for (int q = 6; q < 11; q++)
+        for (int p = q; p < 11; p++)
+            add(four[q], ind4[p], FourIndToNonMatrix[q][p]);
+
+    for (int q = 0; q < 34; q++)
+        five[q] = zero;
+    if (size == 5)
+    {
+        five[0].constant = (n * (n - 1) * (n - 2) * (n - 3) * (n - 4)) / 120;
+        five[1].constant = m * ((n - 2) * (n - 3) * (n - 4)) / 6;
+        five[2].constant = ((m * (m - 1)) / 2 - w) * (n - 4);
+        five[3].constant = w * ((n - 3) * (n - 4)) / 2;
+        add(five[4], tri, ((n - 3) * (n - 4)) / 2);
+        for (int q = 5; q < 11; q++)
+            add(five[q], four[q], n - 4);
+        five[11].constant = w * (m - 2) - 3 * stars3;
+        add(five[11], tri, -3);
+        add(five[11], four[6], -2);
+        add(five[12], tri, m - 3);
+        add(five[12], four[7], -1);
+        five[13].constant = stars4;
+        for (int q = 14; q < 34; q++)
+            for (int p = q; p < 34; p++)
+                add(five[q], ind5[p], FiveIndToNonMatrix[q][p]);
+    }
+
+    // every thread draws from stream tid of seed, through all rounds and samplers
+    std::vector<Rng> rngs;
+    for (int tid = 0; tid < nthreads; tid++)
+        rngs.push_back(Rng(seed, tid));
+    Count batch = 1 << 16;
+    for (int round = 0; ; round++, batch *= 2)
+    {
+        batch = std::min(batch, maxSamples - counts[0].samples);
+        for (int s = 0; s < nsamplers; s++)
+        {
+            if (counts[s].total == 0)
+                continue;
+            std::vector<std::vector<Count> > hits(nthreads, std::vector<Count>(rejectedSample+1, 0));
+            parallelRun(nthreads, [&](int tid)
+            {
+                Rng &rng = rngs[tid];
+                Count mine = batch/nthreads + (tid < batch%nthreads);
+                for (Count k = 0; k < mine; k++)
+                {
+                    int o = (s == 0) ? sampleThreePath(sampler, rng) : (s == 1) ? sampleFourPath(sampler, rng) : sampleProng(sampler, rng);
+                    hits[tid][o]++;
+                }
+            });
+            for (int t = 0; t < nthreads; t++)
+                for (int o = 0; o <= rejectedSample; o++)
+                    counts[s].hits[o] += hits[t][o];
+        }
+        for (int s = 0; s < 3; s++)
+            counts[s].samples += batch;
+
+        ret.relErr = 0;
+        auto evaluate = [&](const LinearEstimate &e, double &value, double &variance)
+        {
+            evaluateEstimate(e, counts, value, variance);
+            if (variance > 0)
+                ret.relErr = std::max(ret.relErr, 1.96*sqrt(variance)/fabs(value));
+        };
+        for (int i = 0; i < 4; i++)
+            evaluate(three[i], ret.nonIndThree[i], ret.varThree[i]);
+        for (int q = 0; q < 11; q++)
+            evaluate(four[q], ret.nonIndFour[q], ret.varFour[q]);
+        for (int q = 0; q < 34; q++)
+            evaluate(five[q], ret.nonIndFive[q], ret.varFive[q]);
+
+        printf("Sampled %lld tuples per sampler, relative error %f\n", (long long) counts[0].samples, ret.relErr);
+        if (ret.relErr <= relErr || counts[0].samples >= maxSamples)
+            break;
+    }
+    ret.samples = counts[0].samples;
+    return ret;
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef ESCAPE_RANDOM_H_
+#define ESCAPE_RANDOM_H_
+
+#include <cstdint>
+#include <limits>
+#include <random>
+
+namespace Escape
+{
+
+// Random numbers for the switch chains. The generator is xoshiro256** (Blackman and Vigna,
+// http://prng.di.unimi.it): 32 bytes of state, a few cycles per number, and a jump function
+// that advances the state by 2^128 numbers. Jumps split one seed into independent streams,
+// one per chain (or per thread), that never overlap in practice.
+//
+// All draws go through the functions below rather than the std:: distributions, whose output
+// differs between standard libraries. So a trajectory only depends on the seed (and the stream),
+// and can be replayed bit for bit on any platform.
+
+class Rng
+{
+public:
+    typedef uint64_t result_type;
+
+    // Stream number stream of seed. Streams of the same seed are 2^128 numbers apart.
+    explicit Rng(uint64_t seed, uint64_t stream = 0)
+    {
+        uint64_t x = seed;
+        for (int i = 0; i < 4; i++)
+            s[i] = splitmix64(x);
+        for (uint64_t i = 0; i < stream; i++)
+            jump();
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()()
+    {
+        uint64_t ret = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return ret;
+    }
+
+    // Returns a uniform integer in [0, n), for n > 0. This is Lemire's multiply-and-reject
+    // method ("Fast Random Integer Generation in an Interval"), which needs a division only
+    // on the rare rejections.
+    uint64_t below(uint64_t n)
+    {
+        unsigned __int128 prod = (unsigned __int128) (*this)() * n;
+        uint64_t low = (uint64_t) prod;
+        if (low < n)
+        {
+            uint64_t threshold = -n % n;
+            while (low < threshold)
+            {
+                prod = (unsigned __int128) (*this)() * n;
+                low = (uint64_t) prod;
+            }
+        }
+        return (uint64_t) (prod >> 64);
+    }
+
+    // Returns a uniform double in [0, 1), with 53 random bits.
+    double uniform()
+    {
+        return ((*this)() >> 11) * (1.0 / 9007199254740992.0); // 2^-53
+    }
+
+    // Advances the state by 2^128 numbers.
+    void jump()
+    {
+        static const uint64_t JUMP[4] = {0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c};
+        uint64_t t[4] = {0, 0, 0, 0};
+        for (int i = 0; i < 4; i++)
+            for (int b = 0; b < 64; b++)
+            {
+                if (JUMP[i] & ((uint64_t) 1 << b))
+                    for (int j = 0; j < 4; j++)
+                        t[j] ^= s[j];
+                (*this)();
+            }
+        for (int j = 0; j < 4; j++)
+            s[j] = t[j];
+    }
+
+    // The state, to save a chain and continue it later (see ChainRunner.h).
+    void getState(uint64_t (&state)[4]) const
+    {
+        for (int j = 0; j < 4; j++)
+            state[j] = s[j];
+    }
+
+    void setState(const uint64_t (&state)[4])
+    {
+        for (int j = 0; j < 4; j++)
+            s[j] = state[j];
+    }
+
+private:
+    uint64_t s[4];
+
+    static uint64_t rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    // Expands the seed into the initial state, as recommended for xoshiro (so that
+    // similar seeds, such as 1 and 2, still give unrelated states).
+    static uint64_t splitmix64(uint64_t &x)
+    {
+        uint64_t z = (x += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+};
+
+// A seed for runs that were not given one. Callers print it, so that the run can be replayed.
+inline uint64_t randomSeed()
+{
+    std::random_device dev;
+    return ((uint64_t) dev() << 32) ^ dev();
+}
+
+}
+#endif
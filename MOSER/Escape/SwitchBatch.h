@@ -0,0 +1,240 @@
+#ifndef ESCAPE_SWITCHBATCH_H_
+#define ESCAPE_SWITCHBATCH_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "Escape/ChainDeltas.h"
+#include "Escape/Parallel.h"
+
+using namespace Escape;
+
+// Making the switches of a chain several at a time (ATAC3, ATAC4, ATAC5 with --batch). The count
+// changes of a switch of (a,b) and (c,d) read the chain graph up to a distance readRadius from a, b,
+// c and d, and the switch writes the graph (neighbors, and triangle counts if they are tracked) up to
+// a distance writeRadius from them. Two switches whose vertices are more than readRadius + writeRadius
+// apart do not see each other: both give the same changes whichever is made first, and they can be
+// made at the same time by two threads.
+//
+// A batch is drawn the way the chain draws its switches one at a time, with the same draws, but the
+// graph is only changed later. Every switch of the batch marks the vertices up to markRadius from its
+// vertices, and the next one joins the batch if no vertex up to probeRadius from its vertices, and
+// none that its draws looked at, is marked (markRadius + probeRadius = readRadius + writeRadius).
+// The first one that does not join ends the batch, and its draws are given back, so that the next
+// batch starts with it. Then the switches of the batch are made in parallel, each giving the changes
+// of the counts, and the steps of the chain add them in order: the rows are those of the chain that
+// makes one switch at a time.
+//
+// The searches stop at switchBallLimit vertices: a switch next to a hub is made alone.
+//
+// Batches pay off on large sparse graphs, where the balls are small and far apart (a random graph
+// with 200k vertices and average degree 4 gives batches of 16). Next to hubs the balls are large
+// and overlap, so on graphs with heavy-tailed degrees most batches hold one or two switches, and a
+// search costs about as much as a switch. So after switchFallbackBatches batches in a row of fewer
+// than switchBatchMinimum switches (or maxSwitches, if smaller), the chain makes its switches one at
+// a time, without searches, for a number of steps that starts at switchFallbackSteps and doubles (up
+// to switchFallbackMaxSteps) every time batching fails again, and goes back to switchFallbackSteps
+// after a large enough batch. The draws are the same either way, so the rows do not depend on when
+// the chain falls back.
+
+const size_t switchBallLimit = 1 << 14;
+const int switchBatchMinimum = 4, switchFallbackBatches = 4;
+const Count switchFallbackSteps = 64, switchFallbackMaxSteps = 4096;
+
+struct SwitchBatcher
+{
+    int maxSwitches;                    // switches in a batch (at most)
+    int markRadius, probeRadius;
+    int rowLength;
+    std::vector<Count> marked;          // marked[v]: last batch that marked v
+    std::vector<Count> seen;            // seen[v]: last search that reached v
+    Count batch, search;
+    std::vector<VertexIdx> ball;        // the vertices reached by the current search
+    std::vector<VertexIdx> tried;       // the vertices that the draws of the current switch looked at
+
+    std::vector<Edge> switches;         // switch i is (switches[2i], switches[2i+1]), where the second src is -1 if none was found
+    std::vector<WideCount> deltas;      // the changes of the counts by switch i, from i * rowLength on
+    size_t next;                        // the next switch to add to the counts
+
+    int smallBatches;                   // batches of fewer than switchBatchMinimum switches in a row
+    Count singleSteps;                  // steps left to make one switch at a time
+    Count fallbackSteps;                // singleSteps of the next fallback
+};
+
+// A batcher of up to maxSwitches switches (none is needed for a single switch at a time), for count
+// rows of rowLength.
+SwitchBatcher newSwitchBatcher(VertexIdx nVertices, int rowLength, int readRadius, int writeRadius, int maxSwitches)
+{
+    SwitchBatcher ret;
+    ret.maxSwitches = maxSwitches;
+    ret.markRadius = (readRadius + writeRadius + 1) / 2;
+    ret.probeRadius = (readRadius + writeRadius) / 2;
+    ret.rowLength = rowLength;
+    if (maxSwitches > 1)
+    {
+        ret.marked.assign(nVertices, 0);
+        ret.seen.assign(nVertices, 0);
+    }
+    ret.batch = ret.search = 0;
+    ret.next = 0;
+    ret.smallBatches = 0;
+    ret.singleSteps = 0;
+    ret.fallbackSteps = switchFallbackSteps;
+    return ret;
+}
+
+// Searches the vertices up to radius from the four vertices of a switch, and marks them (mark) or
+// checks that none of them is marked. Returns false if one is marked, or if there are more than
+// switchBallLimit of them.
+bool searchSwitchBall(SwitchBatcher &b, const ChainGraph &g, const VertexIdx (&from)[4], int radius, bool mark)
+{
+    b.search++;
+    b.ball.clear();
+    for (VertexIdx v : from)
+        if (b.seen[v] != b.search)
+        {
+            b.seen[v] = b.search;
+            b.ball.push_back(v);
+        }
+
+    for (size_t begin = 0, depth = 0; ; depth++)
+    {
+        size_t end = b.ball.size();
+        for (size_t i = begin; i < end; i++)
+        {
+            if (mark)
+                b.marked[b.ball[i]] = b.batch;
+            else if (b.marked[b.ball[i]] == b.batch)
+                return false;
+        }
+        if ((int) depth == radius)
+            return true;
+
+        for (size_t i = begin; i < end; i++)
+            for (VertexIdx x : g.nbors[b.ball[i]])
+                if (b.seen[x] != b.search)
+                {
+                    b.seen[x] = b.search;
+                    b.ball.push_back(x);
+                }
+        if (b.ball.size() > switchBallLimit)
+            return false;
+        begin = end;
+    }
+}
+
+// Draws the next batch of switches, and puts their new edges in edges (the graph is not changed).
+void drawSwitchBatch(SwitchBatcher &b, ChainGraph &g, ChainEdges &edges, Rng &rng, ChainProfile *profile)
+{
+    b.batch++;
+    b.switches.clear();
+    while ((int) b.switches.size() < 2 * b.maxSwitches)
+    {
+        Rng before = rng;
+        Edge ab, cd;
+        b.tried.clear();
+        bool found = pick_switch(g, edges, rng, ab, cd, &b.tried, profile);
+        VertexIdx vertices[4] = {ab.src, ab.dst, cd.src, cd.dst};
+
+        bool joins = true;
+        for (VertexIdx v : b.tried)
+            joins = joins && b.marked[v] != b.batch;
+        if (joins && found)
+            joins = searchSwitchBall(b, g, vertices, b.probeRadius, false);
+        // nothing is marked in an empty batch, so the first switch only fails the search next to a hub
+        bool alone = !joins && b.switches.empty();
+        if (!joins && !alone)
+        {
+            rng = before;
+            break;
+        }
+
+        b.switches.push_back(ab);
+        b.switches.push_back(cd);
+        if (found)
+        {
+            replaceChainEdge(edges, ab.idx, ab.src, cd.dst);
+            replaceChainEdge(edges, cd.idx, cd.src, ab.dst);
+        }
+        if (alone || (found && !searchSwitchBall(b, g, vertices, b.markRadius, true)))
+            break;
+    }
+}
+
+// Makes the switches of the batch in parallel. switchCounts(tid, ab, cd, delta) makes the switch of ab
+// and cd on the chain graph, and adds the changes of the counts to delta (rowLength counts, all 0).
+// It is called from several threads at once, tid numbering them (from 0 to the number of threads).
+template <typename SwitchCounts>
+void makeSwitchBatch(SwitchBatcher &b, SwitchCounts switchCounts)
+{
+    int nSwitches = b.switches.size() / 2;
+    b.deltas.assign((size_t) nSwitches * b.rowLength, 0);
+    parallelFor(0, nSwitches, 1, std::min(numThreads(), nSwitches), [&](int tid, EdgeIdx i)
+    {
+        if (b.switches[2 * i + 1].src != -1)
+            switchCounts(tid, b.switches[2 * i], b.switches[2 * i + 1], b.deltas.data() + i * b.rowLength);
+    });
+    b.next = 0;
+}
+
+// Decides after a batch is drawn whether the next switches are made one at a time (see above).
+void updateSwitchFallback(SwitchBatcher &b)
+{
+    if ((int) b.switches.size() >= 2 * std::min(switchBatchMinimum, b.maxSwitches))
+    {
+        b.smallBatches = 0;
+        b.fallbackSteps = switchFallbackSteps;
+    }
+    else if (++b.smallBatches == switchFallbackBatches)
+    {
+        b.smallBatches = 0;
+        b.singleSteps = b.fallbackSteps;
+        b.fallbackSteps = std::min(2 * b.fallbackSteps, switchFallbackMaxSteps);
+    }
+}
+
+// Makes a step of one switch, without a batch: draws it, and adds its changes of the counts to row.
+template <typename SwitchCounts>
+void singleSwitchStep(SwitchBatcher &b, ChainGraph &g, ChainEdges &edges, Rng &rng, WideCount *row, SwitchCounts switchCounts, ChainProfile *profile)
+{
+    Edge ab, cd;
+    bool found = pick_switch(g, edges, rng, ab, cd, NULL, profile);
+    count_chain_step(profile, found);
+    if (!found)
+        return;
+    replaceChainEdge(edges, ab.idx, ab.src, cd.dst);
+    replaceChainEdge(edges, cd.idx, cd.src, ab.dst);
+    b.deltas.assign(b.rowLength, 0);
+    switchCounts(0, ab, cd, b.deltas.data());
+    for (int p = 0; p < b.rowLength; p++)
+        row[p] += b.deltas[p];
+}
+
+// Makes the next step of a chain with batches of switches (see makeSwitchBatch for switchCounts): adds
+// the changes of the counts by the next switch to row, making a new batch when the last one is used up,
+// or a single switch while the chain falls back to those. With profile, the batches are timed.
+template <typename SwitchCounts>
+void batchedSwitchStep(SwitchBatcher &b, ChainGraph &g, ChainEdges &edges, Rng &rng, WideCount *row, SwitchCounts switchCounts, ChainProfile *profile = NULL)
+{
+    if (b.next == b.switches.size() / 2)
+    {
+        if (b.singleSteps > 0)
+        {
+            b.singleSteps--;
+            singleSwitchStep(b, g, edges, rng, row, switchCounts, profile);
+            return;
+        }
+        PhaseTimer timer(profile);
+        drawSwitchBatch(b, g, edges, rng, profile);
+        timer.lap(phaseBatchDraw);
+        updateSwitchFallback(b);
+        makeSwitchBatch(b, switchCounts);
+        timer.lap(phaseBatchMake);
+    }
+    for (int p = 0; p < b.rowLength; p++)
+        row[p] += b.deltas[b.next * b.rowLength + p];
+    count_chain_step(profile, b.switches[2 * b.next + 1].src != -1);
+    b.next++;
+}
+
+#endif
@@ -0,0 +1,369 @@
+#ifndef ESCAPE_SWITCHCHAIN_H_
+#define ESCAPE_SWITCHCHAIN_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Escape/Graph.h"
+#include "Escape/Random.h"
+
+using namespace Escape;
+
+// Building blocks of the edge switch chains (ATAC3, ATAC4, ATAC5). A step of the chain draws two
+// edges (a,b) and (c,d) uniformly at random, and replaces them by (a,d) and (c,b).
+
+// The edges of the current graph of a chain, each stored once, in a dense array. A switch
+// replaces the two edges it drew by two new ones, so it overwrites the two positions that
+// were drawn: the array never has holes, and a uniform edge is a single draw.
+struct ChainEdges
+{
+    std::vector<VertexIdx> src;   // edge at position e is {src[e], dst[e]}
+    std::vector<VertexIdx> dst;
+};
+
+// Collects the edges of cg (ignoring deleted neighbor slots, which are negative).
+ChainEdges newChainEdges(const CGraph &cg)
+{
+    ChainEdges ret;
+    for (VertexIdx v = 0; v < cg.nVertices; v++)
+        for (EdgeIdx pos = cg.offsets[v]; pos < cg.offsets[v + 1]; pos++)
+            if (cg.nbors[pos] > v)
+            {
+                ret.src.push_back(v);
+                ret.dst.push_back(cg.nbors[pos]);
+            }
+    return ret;
+}
+
+// Draws a uniform random edge in a uniform random direction, i.e. a uniform pair (src,dst)
+// with an edge between src and dst. Returns the position of the edge in edges.
+EdgeIdx sampleChainEdge(const ChainEdges &edges, Rng &rng, VertexIdx &src, VertexIdx &dst)
+{
+    EdgeIdx r = rng.below(2 * edges.src.size());
+    EdgeIdx pos = r / 2;
+    src = (r & 1) ? edges.dst[pos] : edges.src[pos];
+    dst = (r & 1) ? edges.src[pos] : edges.dst[pos];
+    return pos;
+}
+
+// Puts the edge (src,dst) at position pos, in place of the edge that was drawn there.
+void replaceChainEdge(ChainEdges &edges, EdgeIdx pos, VertexIdx src, VertexIdx dst)
+{
+    edges.src[pos] = src;
+    edges.dst[pos] = dst;
+}
+
+// The current graph of a chain. The chain deletes and inserts edges, and asks whether pairs of
+// vertices are adjacent, so the neighbors of every vertex are kept in a vector (in no particular
+// order), and for vertices of degree above hubDegree also in an open-addressing hash table that
+// maps a neighbor to its position in the vector. Then edge lookups, insertions and deletions take
+// constant (expected) time: a short scan for small degrees and a hash lookup for hubs, and deletion
+// moves the last neighbor into the freed position.
+//
+// Optionally (trackTriangles), the graph also keeps the number of triangles on every edge and at
+// every vertex up to date. An insertion or deletion of {u,v} changes them only for u, v, their common
+// neighbors w and the edges {u,w} and {v,w}, so keeping them costs one common-neighbor scan per update,
+// and turns the triangle counts that the 4-vertex deltas need into lookups.
+
+const VertexIdx hubDegree = 32;
+
+// Linear probing table of the neighbors of a hub, without tombstones (deletions shift entries back).
+struct NborTable
+{
+    std::vector<VertexIdx> keys;    // neighbor, or -1 for an empty slot; the size is a power of 2
+    std::vector<VertexIdx> pos;     // position of keys[slot] in the neighbor vector
+};
+
+struct ChainGraph
+{
+    VertexIdx nVertices;
+    EdgeIdx nEdges;                                 // twice the number of edges, as in CGraph
+    std::vector<std::vector<VertexIdx> > nbors;     // neighbors of every vertex
+    std::vector<NborTable> tables;                  // tables[v] is empty unless v is a hub
+
+    bool trackTriangles;
+    std::vector<std::vector<Count> > tris;          // tris[v][i]: triangles on the edge {v, nbors[v][i]} (if tracked)
+    std::vector<Count> vertexTris;                  // triangles at every vertex (if tracked)
+};
+
+inline size_t nborSlot(const NborTable &t, VertexIdx key)
+{
+    return ((uint64_t) key * 0x9e3779b97f4a7c15) >> 20 & (t.keys.size() - 1);
+}
+
+// Returns the slot of key in t, or the empty slot where it would go.
+inline size_t findNborSlot(const NborTable &t, VertexIdx key)
+{
+    size_t slot = nborSlot(t, key);
+    while (t.keys[slot] != key && t.keys[slot] != -1)
+        slot = (slot + 1) & (t.keys.size() - 1);
+    return slot;
+}
+
+// Builds the table of v, filled to at most a quarter (it is rebuilt when it gets half full).
+void buildNborTable(ChainGraph &g, VertexIdx v)
+{
+    size_t size = 1;
+    while (size < 4 * g.nbors[v].size())
+        size *= 2;
+    NborTable &t = g.tables[v];
+    t.keys.assign(size, -1);
+    t.pos.assign(size, 0);
+    for (size_t i = 0; i < g.nbors[v].size(); i++)
+    {
+        size_t slot = findNborSlot(t, g.nbors[v][i]);
+        t.keys[slot] = g.nbors[v][i];
+        t.pos[slot] = i;
+    }
+}
+
+// Removes the key of slot from t, moving back later keys of the same run where needed.
+void eraseNborSlot(NborTable &t, size_t slot)
+{
+    size_t mask = t.keys.size() - 1;
+    size_t next = (slot + 1) & mask;
+    while (t.keys[next] != -1)
+    {
+        size_t home = nborSlot(t, t.keys[next]);
+        // the key at next may move to slot if slot is between its home and next (cyclically)
+        if (((next - home) & mask) >= ((next - slot) & mask))
+        {
+            t.keys[slot] = t.keys[next];
+            t.pos[slot] = t.pos[next];
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+    t.keys[slot] = -1;
+}
+
+
+inline VertexIdx chainDegree(const ChainGraph &g, VertexIdx v)
+{
+    return g.nbors[v].size();
+}
+
+// Returns the position of u among the neighbors of v, or -1 if u is not a neighbor of v.
+inline VertexIdx findChainNbor(const ChainGraph &g, VertexIdx v, VertexIdx u)
+{
+    const NborTable &t = g.tables[v];
+    if (!t.keys.empty())
+    {
+        size_t slot = findNborSlot(t, u);
+        return t.keys[slot] == u ? t.pos[slot] : -1;
+    }
+    const std::vector<VertexIdx> &nb = g.nbors[v];
+    for (size_t i = 0; i < nb.size(); i++)
+        if (nb[i] == u)
+            return i;
+    return -1;
+}
+
+inline bool isChainEdge(const ChainGraph &g, VertexIdx u, VertexIdx v)
+{
+    if (u < 0 || v < 0)
+        return false;
+    // look in the table of a hub, or else scan the shorter list
+    if (g.tables[v].keys.empty() && (!g.tables[u].keys.empty() || g.nbors[u].size() < g.nbors[v].size()))
+        return findChainNbor(g, u, v) >= 0;
+    return findChainNbor(g, v, u) >= 0;
+}
+
+// Adds u to the neighbors of v.
+void addChainNbor(ChainGraph &g, VertexIdx v, VertexIdx u)
+{
+    std::vector<VertexIdx> &nb = g.nbors[v];
+    nb.push_back(u);
+    if (g.trackTriangles)
+        g.tris[v].push_back(0);
+    NborTable &t = g.tables[v];
+    if (t.keys.empty())
+    {
+        if ((VertexIdx) nb.size() > hubDegree)
+            buildNborTable(g, v);
+    }
+    else if (2 * nb.size() > t.keys.size())
+        buildNborTable(g, v);
+    else
+    {
+        size_t slot = findNborSlot(t, u);
+        t.keys[slot] = u;
+        t.pos[slot] = nb.size() - 1;
+    }
+}
+
+// Removes u from the neighbors of v (u must be one). The last neighbor takes its position.
+void deleteChainNbor(ChainGraph &g, VertexIdx v, VertexIdx u)
+{
+    std::vector<VertexIdx> &nb = g.nbors[v];
+    NborTable &t = g.tables[v];
+    VertexIdx i;
+    if (t.keys.empty())
+        i = findChainNbor(g, v, u);
+    else
+    {
+        size_t slot = findNborSlot(t, u);
+        i = t.pos[slot];
+        eraseNborSlot(t, slot);
+        if (i + 1 != (VertexIdx) nb.size())
+            t.pos[findNborSlot(t, nb.back())] = i;
+    }
+    nb[i] = nb.back();
+    nb.pop_back();
+    if (g.trackTriangles)
+    {
+        g.tris[v][i] = g.tris[v].back();
+        g.tris[v].pop_back();
+    }
+}
+
+// Calls fn(w) for every common neighbor w of u and v (other than u and v). Scans the
+// neighbors of the vertex of smaller degree, and looks them up at the other one.
+template <typename F>
+void forEachCommonNbor(const ChainGraph &g, VertexIdx u, VertexIdx v, F fn)
+{
+    if (g.nbors[u].size() > g.nbors[v].size())
+        std::swap(u, v);
+    for (VertexIdx w : g.nbors[u])
+        if (w != v && isChainEdge(g, v, w))
+            fn(w);
+}
+
+// Builds the tables of the hubs, and the triangle counts if trackTriangles, once the neighbors of g are in.
+void finishChainGraph(ChainGraph &g, bool trackTriangles)
+{
+    g.nEdges = 0;
+    g.tables.resize(g.nVertices);
+    for (VertexIdx v = 0; v < g.nVertices; v++)
+    {
+        g.nEdges += g.nbors[v].size();
+        if ((VertexIdx) g.nbors[v].size() > hubDegree)
+            buildNborTable(g, v);
+    }
+
+    g.trackTriangles = trackTriangles;
+    if (trackTriangles)
+    {
+        g.tris.resize(g.nVertices);
+        g.vertexTris.assign(g.nVertices, 0);
+        for (VertexIdx v = 0; v < g.nVertices; v++)
+            g.tris[v].assign(g.nbors[v].size(), 0);
+        for (VertexIdx v = 0; v < g.nVertices; v++)
+            for (size_t i = 0; i < g.nbors[v].size(); i++)
+            {
+                VertexIdx u = g.nbors[v][i];
+                if (u < v)
+                    continue;
+                Count common = 0;
+                forEachCommonNbor(g, v, u, [&](VertexIdx) { common++; });
+                g.tris[v][i] = common;
+                g.tris[u][findChainNbor(g, u, v)] = common;
+                g.vertexTris[v] += common;
+                g.vertexTris[u] += common;
+            }
+        for (VertexIdx v = 0; v < g.nVertices; v++)
+            g.vertexTris[v] /= 2; // every triangle at v is on two of its edges
+    }
+}
+
+ChainGraph newChainGraph(const CGraph &cg, bool trackTriangles = false)
+{
+    ChainGraph g;
+    g.nVertices = cg.nVertices;
+    g.nbors.resize(cg.nVertices);
+    for (VertexIdx v = 0; v < cg.nVertices; v++)
+        for (EdgeIdx pos = cg.offsets[v]; pos < cg.offsets[v + 1]; pos++)
+            if (cg.nbors[pos] >= 0)
+                g.nbors[v].push_back(cg.nbors[pos]);
+    finishChainGraph(g, trackTriangles);
+    return g;
+}
+
+// The chain graph with the edges of a chain (such as a saved one). The neighbors are in another
+// order than in the graph the chain made, which changes none of the counts.
+ChainGraph newChainGraph(VertexIdx nVertices, const ChainEdges &edges, bool trackTriangles = false)
+{
+    ChainGraph g;
+    g.nVertices = nVertices;
+    g.nbors.resize(nVertices);
+    for (size_t e = 0; e < edges.src.size(); e++)
+    {
+        g.nbors[edges.src[e]].push_back(edges.dst[e]);
+        g.nbors[edges.dst[e]].push_back(edges.src[e]);
+    }
+    finishChainGraph(g, trackTriangles);
+    return g;
+}
+
+// Returns the number of triangles on the pair {u,v}, i.e. of common neighbors of u and v.
+// A lookup if {u,v} is an edge and triangles are tracked, and a scan otherwise.
+Count countEdgeTriangles(const ChainGraph &g, VertexIdx u, VertexIdx v)
+{
+    if (g.trackTriangles)
+    {
+        VertexIdx pos = findChainNbor(g, u, v);
+        if (pos >= 0)
+            return g.tris[u][pos];
+    }
+    Count ret = 0;
+    forEachCommonNbor(g, u, v, [&](VertexIdx) { ret++; });
+    return ret;
+}
+
+// Adds sign to the triangle counts of the triangles on {u,v}, which is being inserted (sign 1) or
+// deleted (sign -1). Returns the number of these triangles.
+Count updateChainTriangles(ChainGraph &g, VertexIdx u, VertexIdx v, Count sign)
+{
+    Count common = 0;
+    forEachCommonNbor(g, u, v, [&](VertexIdx w)
+    {
+        g.tris[u][findChainNbor(g, u, w)] += sign;
+        g.tris[w][findChainNbor(g, w, u)] += sign;
+        g.tris[v][findChainNbor(g, v, w)] += sign;
+        g.tris[w][findChainNbor(g, w, v)] += sign;
+        g.vertexTris[w] += sign;
+        common++;
+    });
+    g.vertexTris[u] += sign * common;
+    g.vertexTris[v] += sign * common;
+    return common;
+}
+
+// Inserts the edge {u,v} without changing nEdges. A switch deletes two edges and inserts two, so it
+// links and unlinks its edges and leaves nEdges alone: then it only writes to u, v and their common
+// neighbors, and switches in parts of the graph that are far apart can be made at the same time.
+void linkChainEdge(ChainGraph &g, VertexIdx u, VertexIdx v)
+{
+    addChainNbor(g, u, v);
+    addChainNbor(g, v, u);
+    if (g.trackTriangles)
+    {
+        Count common = updateChainTriangles(g, u, v, 1);
+        g.tris[u].back() = common; // u and v were added last
+        g.tris[v].back() = common;
+    }
+}
+
+// Deletes the edge {u,v} without changing nEdges (see linkChainEdge).
+void unlinkChainEdge(ChainGraph &g, VertexIdx u, VertexIdx v)
+{
+    if (g.trackTriangles)
+        updateChainTriangles(g, u, v, -1);
+    deleteChainNbor(g, u, v);
+    deleteChainNbor(g, v, u);
+}
+
+void addChainEdge(ChainGraph &g, VertexIdx u, VertexIdx v)
+{
+    linkChainEdge(g, u, v);
+    g.nEdges += 2;
+}
+
+void deleteChainEdge(ChainGraph &g, VertexIdx u, VertexIdx v)
+{
+    unlinkChainEdge(g, u, v);
+    g.nEdges -= 2;
+}
+
+#endif
@@ -54,6 +54,12 @@ struct TriangleList
     EdgeIdx *trioffsets;
 };
 
+void delTriangleList(TriangleList& list)
+{
+  delete[] list.triangles;
+  delete[] list.trioffsets;
+}
+
 
 
 // The wedge enumeration algorithm that produces all triangles
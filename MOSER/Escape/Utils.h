@@ -2,6 +2,8 @@
 #define ESCAPE_UTILS_H_
 
 #include <algorithm>
+#include <cstdint>
+#include <vector>
 
 namespace Escape
 {
@@ -31,6 +33,42 @@ T czsub(T x, T y)
 }
 
 
+//Appends the common elements of the sorted arrays a[0..na) and b[0..nb) to out, in order.
+//Similar lengths use a branchless merge. When one array is much shorter, each of its
+//elements is instead found in the longer one by binary search, starting after the last match.
+template <typename T>
+void intersectSorted(const T *a, int64_t na, const T *b, int64_t nb, std::vector<T> &out)
+{
+  if (na > nb)
+  {
+    std::swap(a, b);
+    std::swap(na, nb);
+  }
+
+  if (na * 16 < nb)
+  {
+    const T *lo = b, *end = b + nb;
+    for (int64_t p = 0; p < na && lo < end; ++p)
+    {
+      lo = std::lower_bound(lo, end, a[p]);
+      if (lo < end && *lo == a[p])
+        out.push_back(*lo++);
+    }
+    return;
+  }
+
+  int64_t pa = 0, pb = 0;
+  while (pa < na && pb < nb)
+  {
+    T x = a[pa], y = b[pb];
+    if (x == y)
+      out.push_back(x);
+    pa += (x <= y);
+    pb += (y <= x);
+  }
+}
+
+
 
 }
 #endif
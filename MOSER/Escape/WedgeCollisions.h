@@ -2,12 +2,15 @@
 #define ESCAPE_WEDGECOLLISIONS_H_
 
 #include <algorithm>
+#include <vector>
 
 #include "Escape/ErrorCode.h"
 #include "Escape/Graph.h"
 #include "Escape/Digraph.h"
 #include "Escape/Triadic.h"
 #include "Escape/Utils.h"
+#include "Escape/Parallel.h"
+#include "Escape/FourVertex.h"
 
 using namespace Escape;
 
@@ -754,184 +757,223 @@ CollisionPatterns chordalCycleWedgeCollision(CGraph *g, CGraph *gout)
 }
 
 
-CollisionPatterns fromTriangleList(CGraph *g, TriangleList *allTris)
+// The work of fromTriangleList for a single vertex i: the wedges i -- j -- k with k > i are counted
+// in wedges, and the three-wedge collisions, chordal-wedge collisions (counted twice) and wheels
+// found at i are added to counts. wedges and diamond_count are per-thread scratch, and are left
+// cleared.
+void fromTriangleListAt(CGraph *g, TriangleList *allTris, VertexIdx i, WedgeScratch &wedges, VertexIdx *diamond_count, CollisionPatterns &counts)
 {
-   CollisionPatterns ret;
-
-   ret.chordalWedgeCol = 0;
-   ret.threeWedgeCol = 0;
-   ret.wheel = 0;
-
-   VertexIdx i,j,k,ell;
-
-   VertexIdx *wedge_count = new VertexIdx[g->nVertices+1];
-  
-   VertexIdx *diamond_count = new VertexIdx[g->nVertices+1];
-   
-   EdgeIdx low, mid, high;
-
-   int DEBUG = 0;
-
-   for (i=0; i < g->nVertices; i++)
-   {
-       wedge_count[i] = 0;
-       diamond_count[i] = 0;
-   }
-
+    VertexIdx j,k,ell;
+    VertexIdx *wedge_count = wedges.wedge_count;
+    EdgeIdx low, mid = 0, high;
+    int DEBUG = 0;
 
-   for (i=0; i < g->nVertices; ++i) // loop over vertices
-   {
-        VertexIdx degi = g->offsets[i+1] - g->offsets[i];
+    VertexIdx degi = g->offsets[i+1] - g->offsets[i];
  
-        // loop over wedges to populate the ends of the wedges
-        for (EdgeIdx pos = g->offsets[i]; pos < g->offsets[i+1]; ++pos) // loop over in-neighbors of i
-        {
-            j = g->nbors[pos]; // j is current in-neighbor
-            for (EdgeIdx next = g->offsets[j]; next < g->offsets[j+1]; ++next) // loop over out-neighbors of j, note this gives an outout wedge
-            {
-                k = g->nbors[next];  // i -- j -- k is wedge centered at j
-                if (k <= i)
-                    continue;
-                wedge_count[k]++;
-            }
-        } 
-         
-
-        for (EdgeIdx pos = g->offsets[i]; pos < g->offsets[i+1]; ++pos)
+    // loop over wedges to populate the ends of the wedges
+    for (EdgeIdx pos = g->offsets[i]; pos < g->offsets[i+1]; ++pos) // loop over in-neighbors of i
+    {
+        j = g->nbors[pos]; // j is current in-neighbor
+        for (EdgeIdx next = g->offsets[j]; next < g->offsets[j+1]; ++next) // loop over out-neighbors of j, note this gives an outout wedge
         {
-            j = g->nbors[pos];
-            VertexIdx degj = g->offsets[j+1] - g->offsets[j];
-            EdgeIdx edge_pos = 0;
-            if ((degj < degi) || (degj==degi && j <= i))
-                edge_pos = g->getEdgeBinary(j,i);
-            else
-                edge_pos = pos;
+            k = g->nbors[next];  // i -- j -- k is wedge centered at j
+            if (k <= i)
+                continue;
+            if (wedge_count[k]++ == 0)
+                wedges.touched.push_back(k);
+        }
+    } 
+     
 
+    for (EdgeIdx pos = g->offsets[i]; pos < g->offsets[i+1]; ++pos)
+    {
+        j = g->nbors[pos];
+        VertexIdx degj = g->offsets[j+1] - g->offsets[j];
+        EdgeIdx edge_pos = 0;
+        if ((degj < degi) || (degj==degi && j <= i))
+            edge_pos = g->getEdgeBinary(j,i);
+        else
+            edge_pos = pos;
 
-            for (EdgeIdx tri_pos = allTris->trioffsets[edge_pos]; tri_pos < allTris->trioffsets[edge_pos+1]; tri_pos++)
-            {
-                k = allTris->triangles[tri_pos];
-                VertexIdx degk = g->offsets[k+1] - g->offsets[k];
-                EdgeIdx new_pos = 0;
-                if ((degk < degj) || (degk==degj && k <= j))
-                    new_pos = g->getEdgeBinary(k,j);
-                else
-                    new_pos = g->getEdgeBinary(j,k);
-                if (DEBUG)
-                    printf("---Handling %lld %lld %lld\n",i,j,k);
 
+        for (EdgeIdx tri_pos = allTris->trioffsets[edge_pos]; tri_pos < allTris->trioffsets[edge_pos+1]; tri_pos++)
+        {
+            k = allTris->triangles[tri_pos];
+            VertexIdx degk = g->offsets[k+1] - g->offsets[k];
+            EdgeIdx new_pos = 0;
+            if ((degk < degj) || (degk==degj && k <= j))
+                new_pos = g->getEdgeBinary(k,j);
+            else
+                new_pos = g->getEdgeBinary(j,k);
+            if (DEBUG)
+                printf("---Handling %lld %lld %lld\n",i,j,k);
 
-                low = allTris->trioffsets[new_pos];
-                high = allTris->trioffsets[new_pos+1]-1;
 
+            low = allTris->trioffsets[new_pos];
+            high = allTris->trioffsets[new_pos+1]-1;
 
-                while(low <= high)
-                {
-                     mid = (low+high)/2;
-                     if (allTris->triangles[mid] == i)
-                         break;
-                     if (allTris->triangles[mid] > i)
-                         high = mid-1;
-                     else
-                         low = mid+1;
-                }
-                if (low > high)
-                {
-                    printf("Error in binary search of allTris %lld %lld %lld\n",i,j,k);
-                    printf("%lld %lld: ",i,j);
-                    printf("%lld\n",allTris->trioffsets[edge_pos]);
-                    for (EdgeIdx tri_pos2 = allTris->trioffsets[edge_pos]; tri_pos2 < allTris->trioffsets[edge_pos+1]; tri_pos2++)
-                        printf("%lld ",allTris->triangles[tri_pos2]);
-                    printf("\n");
-                    printf("%lld %lld: ",j,k);
-                    printf("%lld\n",allTris->trioffsets[new_pos]);
-                    for (EdgeIdx tri_pos3 = allTris->trioffsets[new_pos]; tri_pos3 < allTris->trioffsets[new_pos+1]; tri_pos3++)
-                        printf("%lld ",allTris->triangles[tri_pos3]);
-                    printf("\n");
-                    printf("%lld %lld: ",k,j);
-                    EdgeIdx new_pos4 = g->getEdgeBinary(k,j);
-                    printf("%lld\n",allTris->trioffsets[new_pos4]);
-                    for (EdgeIdx tri_pos4 = allTris->trioffsets[new_pos4]; tri_pos4 < allTris->trioffsets[new_pos4+1]; tri_pos4++)
-                        printf("%lld ",allTris->triangles[tri_pos4]);
-                    printf("\n");
-                    for (EdgeIdx ptr = g->offsets[j]; ptr < g->offsets[j+1]; ptr++)
-                        printf("%lld ",g->nbors[ptr]);
-                    printf("\n");
-                    exit(EXIT_FAILURE);
-                }
-                
-                for (EdgeIdx next_tri_pos = mid; next_tri_pos < allTris->trioffsets[new_pos+1]; next_tri_pos++)
-                {
-                    ell = allTris->triangles[next_tri_pos];
-                    if (wedge_count[ell] > 2)
-                    {
-                        if (DEBUG)
-                            printf("Consider %lld %lld %lld %lld: adding %lld\n",i,j,k,ell,wedge_count[ell]-2);
 
-                        ret.chordalWedgeCol += wedge_count[ell]-2;
-                    }
-                    if (i < k && i < ell)
-                    {
-                        diamond_count[ell]++;
-                    }
-                }
+            while(low <= high)
+            {
+                 mid = (low+high)/2;
+                 if (allTris->triangles[mid] == i)
+                     break;
+                 if (allTris->triangles[mid] > i)
+                     high = mid-1;
+                 else
+                     low = mid+1;
+            }
+            if (low > high)
+            {
+                printf("Error in binary search of allTris %lld %lld %lld\n",i,j,k);
+                printf("%lld %lld: ",i,j);
+                printf("%lld\n",allTris->trioffsets[edge_pos]);
+                for (EdgeIdx tri_pos2 = allTris->trioffsets[edge_pos]; tri_pos2 < allTris->trioffsets[edge_pos+1]; tri_pos2++)
+                    printf("%lld ",allTris->triangles[tri_pos2]);
+                printf("\n");
+                printf("%lld %lld: ",j,k);
+                printf("%lld\n",allTris->trioffsets[new_pos]);
+                for (EdgeIdx tri_pos3 = allTris->trioffsets[new_pos]; tri_pos3 < allTris->trioffsets[new_pos+1]; tri_pos3++)
+                    printf("%lld ",allTris->triangles[tri_pos3]);
+                printf("\n");
+                printf("%lld %lld: ",k,j);
+                EdgeIdx new_pos4 = g->getEdgeBinary(k,j);
+                printf("%lld\n",allTris->trioffsets[new_pos4]);
+                for (EdgeIdx tri_pos4 = allTris->trioffsets[new_pos4]; tri_pos4 < allTris->trioffsets[new_pos4+1]; tri_pos4++)
+                    printf("%lld ",allTris->triangles[tri_pos4]);
+                printf("\n");
+                for (EdgeIdx ptr = g->offsets[j]; ptr < g->offsets[j+1]; ptr++)
+                    printf("%lld ",g->nbors[ptr]);
+                printf("\n");
+                exit(EXIT_FAILURE);
             }
             
-            for (EdgeIdx tri_pos = allTris->trioffsets[edge_pos]; tri_pos < allTris->trioffsets[edge_pos+1]; tri_pos++)
+            for (EdgeIdx next_tri_pos = mid; next_tri_pos < allTris->trioffsets[new_pos+1]; next_tri_pos++)
             {
-                k = allTris->triangles[tri_pos];
-                if (k <= i)
-                    continue;
-                VertexIdx degk = g->offsets[k+1] - g->offsets[k];
-                VertexIdx new_pos = 0;
-                if ((degk < degj) || (degk==degj && k <= j))
-                    new_pos = g->getEdgeBinary(k,j);
-                else
-                    new_pos = g->getEdgeBinary(j,k);
-                if (DEBUG)
-                    printf("---Handling %lld %lld %lld\n",i,j,k);
-
-
-                low = allTris->trioffsets[new_pos];
-                high = allTris->trioffsets[new_pos+1]-1;
-
-                while(low <= high)
+                ell = allTris->triangles[next_tri_pos];
+                if (wedge_count[ell] > 2)
                 {
-                     mid = (low+high)/2;
-                     if (allTris->triangles[mid] == i)
-                         break;
-                     if (allTris->triangles[mid] > i)
-                         high = mid-1;
-                     else
-                         low = mid+1;
+                    if (DEBUG)
+                        printf("Consider %lld %lld %lld %lld: adding %lld\n",i,j,k,ell,wedge_count[ell]-2);
+
+                    counts.chordalWedgeCol += wedge_count[ell]-2;
                 }
-               
-                for (EdgeIdx next_tri_pos = mid; next_tri_pos < allTris->trioffsets[new_pos+1]; next_tri_pos++)
+                if (i < k && i < ell)
                 {
-                    ell = allTris->triangles[next_tri_pos];
-//                     printf("ell %lld, count %lld, total %lld\n",ell,diamond_count[ell],ret.wheel);
-                    ret.wheel += diamond_count[ell]*(diamond_count[ell]-1)/2;
-                    diamond_count[ell] = 0;
+                    diamond_count[ell]++;
                 }
             }
         }
-
-        for (EdgeIdx pos = g->offsets[i]; pos < g->offsets[i+1]; ++pos) // loop over in-neighbors of i
+        
+        for (EdgeIdx tri_pos = allTris->trioffsets[edge_pos]; tri_pos < allTris->trioffsets[edge_pos+1]; tri_pos++)
         {
-            j = g->nbors[pos]; // j is current in-neighbor
-            for (EdgeIdx next = g->offsets[j]; next < g->offsets[j+1]; ++next) // loop over out-neighbors of j, note this gives an outout wedge
+            k = allTris->triangles[tri_pos];
+            if (k <= i)
+                continue;
+            VertexIdx degk = g->offsets[k+1] - g->offsets[k];
+            VertexIdx new_pos = 0;
+            if ((degk < degj) || (degk==degj && k <= j))
+                new_pos = g->getEdgeBinary(k,j);
+            else
+                new_pos = g->getEdgeBinary(j,k);
+            if (DEBUG)
+                printf("---Handling %lld %lld %lld\n",i,j,k);
+
+
+            low = allTris->trioffsets[new_pos];
+            high = allTris->trioffsets[new_pos+1]-1;
+
+            while(low <= high)
             {
-                k = g->nbors[next];  // i <- j -> k is outout wedge centered at j
-//                 if (k <= i) // k is higher in the order, so ignore wedge
-//                     continue;
-                if (DEBUG)
-                    if (wedge_count[k] != 0)
-                        printf("%lld %lld %lld: %lld\n",i,j,k,wedge_count[k]);
-                ret.threeWedgeCol += (wedge_count[k])*(wedge_count[k]-1)*(wedge_count[k]-2)/6;
-                wedge_count[k] = 0;
+                 mid = (low+high)/2;
+                 if (allTris->triangles[mid] == i)
+                     break;
+                 if (allTris->triangles[mid] > i)
+                     high = mid-1;
+                 else
+                     low = mid+1;
+            }
+           
+            for (EdgeIdx next_tri_pos = mid; next_tri_pos < allTris->trioffsets[new_pos+1]; next_tri_pos++)
+            {
+                ell = allTris->triangles[next_tri_pos];
+//                     printf("ell %lld, count %lld, total %lld\n",ell,diamond_count[ell],counts.wheel);
+                counts.wheel += diamond_count[ell]*(diamond_count[ell]-1)/2;
+                diamond_count[ell] = 0;
             }
         }
+    }
+
+    // every vertex k at the end of three wedges gives a three-wedge collision
+    for (VertexIdx end : wedges.touched)
+    {
+        counts.threeWedgeCol += (wedge_count[end])*(wedge_count[end]-1)*(wedge_count[end]-2)/6;
+        wedge_count[end] = 0;
+    }
+    wedges.touched.clear();
+}
+
+// Three-wedge collision, chordal-wedge collision and 4-wheel counter
+// Input: A graph g sorted by ID, and the list of all its triangles
+// Output: The three counts, in a CollisionPatterns
+//
+// The vertices are processed in parallel, each thread with its own wedge and diamond counts,
+// in blocks of vertices of roughly equal numbers of wedges. All counts are integer sums over
+// vertices, so the result does not depend on the number of threads.
+
+CollisionPatterns fromTriangleList(CGraph *g, TriangleList *allTris)
+{
+   CollisionPatterns ret;
+
+   ret.chordalWedgeCol = 0;
+   ret.threeWedgeCol = 0;
+   ret.wheel = 0;
+
+   int nthreads = numThreads();
+
+   // work[i] is the number of wedges from i
+   EdgeIdx *work = new EdgeIdx[g->nVertices+1];
+   for (VertexIdx i=0; i < g->nVertices; ++i)
+   {
+       work[i] = 0;
+       for (EdgeIdx pos = g->offsets[i]; pos < g->offsets[i+1]; ++pos)
+       {
+           VertexIdx j = g->nbors[pos];
+           work[i] += g->offsets[j+1] - g->offsets[j];
+       }
+   }
+
+   std::vector<WedgeScratch> wedges(nthreads);
+   std::vector<VertexIdx *> diamond_count(nthreads);
+   std::vector<PaddedCount> three_wedge(nthreads, PaddedCount{0, {}});
+   std::vector<PaddedCount> chordal_wedge(nthreads, PaddedCount{0, {}});
+   std::vector<PaddedCount> wheel(nthreads, PaddedCount{0, {}});
+   for (int t=0; t < nthreads; t++)
+   {
+       wedges[t] = newWedgeScratch(g->nVertices);
+       diamond_count[t] = new VertexIdx[g->nVertices+1];
+       std::fill(diamond_count[t], diamond_count[t]+g->nVertices+1, 0);
    }
+
+   parallelForWeighted(g->nVertices, work, nthreads, [&](int tid, VertexIdx i)
+   {
+       CollisionPatterns counts = {0, 0, 0};
+       fromTriangleListAt(g, allTris, i, wedges[tid], diamond_count[tid], counts);
+       three_wedge[tid].value += counts.threeWedgeCol;
+       chordal_wedge[tid].value += counts.chordalWedgeCol;
+       wheel[tid].value += counts.wheel;
+   });
+
+   for (int t=0; t < nthreads; t++)
+   {
+       ret.threeWedgeCol += three_wedge[t].value;
+       ret.chordalWedgeCol += chordal_wedge[t].value;
+       ret.wheel += wheel[t].value;
+       delWedgeScratch(wedges[t]);
+       delete[] diamond_count[t];
+   }
+   delete[] work;
+
    ret.chordalWedgeCol = ret.chordalWedgeCol/2;
    return ret;
 }
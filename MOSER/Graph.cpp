@@ -204,11 +204,20 @@ void CGraph::sortById() const
 // Thus, (after the relabeling), for all i < j, the degree of i is less than that of j.
 
 CGraph CGraph::renameByDegreeOrder() const
+{
+    VertexIdx *mapping = new VertexIdx[nVertices];
+    CGraph ret = renameByDegreeOrder(mapping);
+    delete[] mapping;
+    return ret;
+}
+
+// As above, but the caller gets the relabeling in mapping: mapping[i] is the new label of old vertex i.
+
+CGraph CGraph::renameByDegreeOrder(VertexIdx *mapping) const
 {
     CGraph ret = newCGraph(nVertices, nEdges);
     Pair *deg_info = new Pair[nVertices];
 
-    VertexIdx *mapping = new VertexIdx[nVertices];
     VertexIdx *inverse = new VertexIdx[nVertices];
 
 
@@ -250,6 +259,8 @@ CGraph CGraph::renameByDegreeOrder() const
         ret.offsets[new_label+1] = current; // all neighbors of new_label have been added, so we set offset for new_label+1
     }
 
+    delete[] deg_info;
+    delete[] inverse;
     return ret;
 }
 
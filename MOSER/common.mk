@@ -1,8 +1,8 @@
 CC       := g++
 INCLUDES := -I $(ESCAPE_HOME)
 DEFINES  := 
-CFLAGS   := -Wall -std=c++11 -g -O3 #-O3 -Werror
-LDFLAGS  := -L $(ESCAPE_HOME)
+CFLAGS   := -Wall -std=c++11 -g -O3 -pthread #-O3 -Werror
+LDFLAGS  := -L $(ESCAPE_HOME) -pthread
 LDLIBS   := -lescape -lc++
 
 
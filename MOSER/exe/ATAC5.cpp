@@ -0,0 +1,178 @@
+#include "Escape/GraphIO.h"
+#include "Escape/EdgeHash.h"
+#include "Escape/Digraph.h"
+#include "Escape/Triadic.h"
+#include "Escape/FourVertex.h"
+#include "Escape/Conversion.h"
+#include "Escape/GetAllCounts.h"
+#include "Escape/ChainDeltas.h"
+#include "Escape/ChainRunner.h"
+#include "Escape/SwitchBatch.h"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+
+using namespace Escape;
+
+// Deletes (add == false) or adds the edge, and updates the counts of all sizes. m is the number of
+// edges before the change. With profile, the phases are timed.
+void track_edge_change(ChainGraph &cg, FiveDeltaCounter &fc, Edge edge, bool add, EdgeIdx m, WideCount (&nonInd_three)[4], WideCount (&nonInd_four)[11], WideCount (&nonInd_five)[34], ChainProfile *profile)
+{
+    WideCount delta3[4], delta4[11];
+    Count delta5[34];
+    WideCount w1 = nonInd_three[2], t1 = nonInd_three[3];
+    PhaseTimer timer(profile);
+
+    if (add)
+    {
+        update_5node_addition(cg, fc, edge, delta5);
+        timer.lap(phaseUpdate5);
+        update_3node_addition(cg, edge, delta3);
+        update_counts_using_delta(nonInd_three, delta3, 4);
+        timer.lap(phaseUpdate3);
+        update_4node_addition(cg, edge, nonInd_three, delta4, w1, t1, m);
+        timer.lap(phaseUpdate4);
+        simulate_addition_on_CG(cg, edge);
+    }
+    else
+    {
+        update_5node_deletion(cg, fc, edge, delta5);
+        timer.lap(phaseUpdate5);
+        update_3node_deletion(cg, edge, delta3);
+        update_counts_using_delta(nonInd_three, delta3, 4);
+        timer.lap(phaseUpdate3);
+        update_4node_deletion(cg, edge, nonInd_three, delta4, w1, t1, m);
+        timer.lap(phaseUpdate4);
+        simulate_deletion_on_CG(cg, edge);
+    }
+    timer.lap(phaseGraph);
+    update_counts_using_delta(nonInd_four, delta4, 11);
+    update_counts_using_delta(nonInd_five, delta5, 34);
+}
+
+// Makes the switch of ab and cd on cg, and adds the changes of the connected 5-vertex counts and
+// of the smaller counts to the counts (the disconnected 5-vertex counts are left alone).
+void switch_tracking(ChainGraph &cg, FiveDeltaCounter &fc, Edge ab, Edge cd, WideCount (&nonInd_three)[4], WideCount (&nonInd_four)[11], WideCount (&nonInd_five)[34], ChainProfile *profile)
+{
+    Edge ad = {ab.src, cd.dst};
+    Edge cb = {cd.src, ab.dst};
+    EdgeIdx m = cg.nEdges / 2; // the switch keeps the edge count
+    track_edge_change(cg, fc, ab, false, m, nonInd_three, nonInd_four, nonInd_five, profile);
+    track_edge_change(cg, fc, cd, false, m - 1, nonInd_three, nonInd_four, nonInd_five, profile);
+    track_edge_change(cg, fc, ad, true, m - 2, nonInd_three, nonInd_four, nonInd_five, profile);
+    track_edge_change(cg, fc, cb, true, m - 1, nonInd_three, nonInd_four, nonInd_five, profile);
+}
+
+bool one_full_switch_tracking(ChainGraph &cg, ChainEdges &edges, FiveDeltaCounter &fc, WideCount (&nonInd_three)[4], WideCount (&nonInd_four)[11], WideCount (&nonInd_five)[34], Rng &rng, ChainProfile *profile)
+{
+    Edge ab, cd;
+    bool found = pick_switch(cg, edges, rng, ab, cd, NULL, profile);
+    count_chain_step(profile, found);
+    if (!found)
+        return false;
+
+    switch_tracking(cg, fc, ab, cd, nonInd_three, nonInd_four, nonInd_five, profile);
+
+    // the disconnected 5-vertex patterns follow from the smaller counts
+    disconnectedFive(cg.nVertices, cg.nEdges / 2, nonInd_three, nonInd_four, nonInd_five);
+
+    // the new edges take the places of the old ones in the edge array
+    replaceChainEdge(edges, ab.idx, ab.src, cd.dst);
+    replaceChainEdge(edges, cd.idx, cd.src, ab.dst);
+
+    return true;
+}
+
+// A chain of its own: a copy of the chain graph and the edges, and a stream of the seed. Batched
+// switches are made with a counter for every thread. The 5-vertex changes read the neighbors of
+// the vertices up to distance 2 from the switched vertices (as the 4-vertex changes do), and a
+// switch writes the triangle counts of their neighbors, so batched switches must be more than 3 apart.
+// With --profile, there is a profile for every thread (see newChainProfiles).
+struct FiveVertexChain
+{
+    ChainGraph graph;
+    ChainEdges edges;
+    FiveDeltaCounter counter;
+    Rng rng;
+    SwitchBatcher batcher;
+    std::vector<FiveDeltaCounter> counters;
+    std::vector<ChainProfile> profiles;
+
+    void step(WideCount *row)
+    {
+        if (batcher.maxSwitches <= 1)
+        {
+            one_full_switch_tracking(graph, edges, counter, rowBlock<4>(row), rowBlock<11>(row + 4), rowBlock<34>(row + 15), rng, threadProfile(profiles, 0));
+            return;
+        }
+        if (counters.empty())
+            counters.assign(std::min(numThreads(), batcher.maxSwitches), counter);
+        batchedSwitchStep(batcher, graph, edges, rng, row, [&](int tid, Edge ab, Edge cd, WideCount *delta)
+        {
+            switch_tracking(graph, counters[tid], ab, cd, rowBlock<4>(delta), rowBlock<11>(delta + 4), rowBlock<34>(delta + 15), threadProfile(profiles, tid));
+        }, threadProfile(profiles, 0));
+        disconnectedFive(graph.nVertices, graph.nEdges / 2, rowBlock<4>(row), rowBlock<11>(row + 4), rowBlock<34>(row + 15));
+    }
+};
+
+// Usage: ATAC5 <graph> [steps[,steps...]] [-i] [--serial-test] [--stats] [--reservoir <rows>] [--batch <switches>] [--checkpoint <rows>] [--resume] [--profile <rows>] [--check <rows>] [--burn-in <steps>] [--thin <steps>] [--seed <seed>]
+// (see parseChainOptions). Writes the 3-vertex, 4-vertex and 5-vertex counts along every chain.
+int main(int argc, char *argv[])
+{
+    auto t_profile_begin = std::chrono::high_resolution_clock::now();
+    TriangleInfo trinfo;
+    Graph g;
+    if (loadGraph(argv[1], g, 1, IOFormat::escape))
+        exit(1);
+
+    ChainOptions opt = parseChainOptions(argc, argv);
+
+    CGraph cg = makeCSR(g);
+    cg.sortById();
+    ChainEdges edges = newChainEdges(cg);
+    ChainGraph chain = newChainGraph(cg, true); // with triangle counts, for the 4-vertex deltas
+    FiveDeltaCounter five_counter = newFiveDeltaCounter(cg.nVertices);
+
+    CGraph cg_relabel = cg.renameByDegreeOrder();
+    cg_relabel.sortById();
+
+    CDAG dag = degreeOrdered(&cg_relabel);
+    (dag.outlist).sortById();
+    (dag.inlist).sortById();
+
+    auto t_graph_load_end = std::chrono::high_resolution_clock::now();
+    auto t_graph_load = std::chrono::duration_cast<std::chrono::nanoseconds>(t_graph_load_end - t_profile_begin);
+    printf("Graph loaded in: %.3f seconds.\n", t_graph_load.count() * 1e-9);
+
+    double nonInd_three[4], nonInd_four[11], nonInd_five[34];
+    NoninducedFourCounts counted_four;
+    EdgeIdx counted_five[21];
+
+    auto t_count_begin = std::chrono::high_resolution_clock::now();
+    trinfo = getAllThree(&cg_relabel, &dag, nonInd_three, true);
+    getAllFour(&cg_relabel, &dag, nonInd_four, trinfo, &counted_four);
+    getAllFive(&cg_relabel, &dag, nonInd_four, nonInd_five, trinfo, allPatterns, &counted_four, counted_five);
+    auto t_count_end = std::chrono::high_resolution_clock::now();
+    auto t_count = std::chrono::duration_cast<std::chrono::nanoseconds>(t_count_end - t_count_begin);
+    printf("3, 4 and 5 Nodes Counted in: %.3f seconds.\n", t_count.count() * 1e-9);
+
+    // the chains track exact counts, starting from exact versions of the initial counts
+    WideCount initial[49];
+    exactThree(&cg_relabel, trinfo, rowBlock<4>(initial));
+    exactFour(&cg_relabel, &dag, trinfo, counted_four, rowBlock<11>(initial + 4));
+    exactFive(&cg_relabel, rowBlock<4>(initial), rowBlock<11>(initial + 4), counted_five, rowBlock<34>(initial + 15));
+
+    auto t_dynamic_begin = std::chrono::high_resolution_clock::now();
+    runChains(opt, cg, 5, initial, [&](int k)
+    {
+        FiveVertexChain ret = {chain, edges, five_counter, Rng(opt.seed, k), newSwitchBatcher(cg.nVertices, 49, 2, 1, opt.batch), std::vector<FiveDeltaCounter>(),
+                               newChainProfiles(opt)};
+        return ret;
+    });
+    auto t_dynamic_end = std::chrono::high_resolution_clock::now();
+    auto t_dynamic = std::chrono::duration_cast<std::chrono::nanoseconds>(t_dynamic_end - t_dynamic_begin);
+    auto t_full = std::chrono::duration_cast<std::chrono::nanoseconds>(t_dynamic_end - t_profile_begin);
+    printf("Track and Count took: %.3f seconds.\n", t_dynamic.count() * 1e-9);
+    printf("Full Algorithm took: %.3f seconds.\n", t_full.count() * 1e-9);
+}
@@ -5,11 +5,30 @@
 #include "Escape/FourVertex.h"
 #include "Escape/Utils.h"
 #include "Escape/GetAllCounts.h"
+#include <cstring>
 
 using namespace Escape;
 
+// Usage: count_five <graph> [-p <patterns>]
+//   -p <patterns>: comma separated list of 5-vertex patterns (e.g. "20" for 5-cycles), whose induced
+//                  counts are wanted. Only the non-induced counts these depend on are computed, the others
+//                  are written as nan.
 int main(int argc, char *argv[])
 {
+  PatternMask five_mask = allPatterns, four_mask = allPatterns;
+  for (int i = 2; i < argc; i++)
+      if (strcmp(argv[i],"-p") == 0 && i+1 < argc)
+      {
+          PatternMask induced = parsePatternList(argv[++i], 34);
+          if (!induced)
+          {
+              printf("could not parse pattern list %s, patterns are numbered 0 to 33\n",argv[i]);
+              exit(1);
+          }
+          five_mask = fiveNonInducedNeeded(induced);
+          four_mask = fourNeededForFive(five_mask);
+      }
+
   Graph g;
   printf("Loading graph\n");
   if (loadGraph(argv[1], g, 1, IOFormat::escape))
@@ -29,12 +48,11 @@ int main(int argc, char *argv[])
 
   double nonInd_three[4], nonInd_four[11], nonInd_five[34];
 
-  printf("Counting 3-vertex\n");
-  getAllThree(&cg_relabel, &dag, nonInd_three);
-  printf("Counting 4-vertex\n");
-  getAllFour(&cg_relabel, &dag, nonInd_four);
+  printf("Counting 3-vertex and 4-vertex\n");
+  TriangleInfo tri_info = getAllThreeAndFour(&cg_relabel, &dag, nonInd_three, nonInd_four, NULL, four_mask);
   printf("Counting 5-vertex\n");
-  getAllFive(&cg_relabel, &dag, nonInd_four, nonInd_five);
+  getAllFive(&cg_relabel, &dag, nonInd_four, nonInd_five, tri_info, five_mask);
+  delTriangleInfo(tri_info);
 
   FILE* f = fopen("out.txt","w");
   if (!f)
@@ -5,12 +5,74 @@
 #include "Escape/FourVertex.h"
 #include "Escape/Conversion.h"
 #include "Escape/GetAllCounts.h"
+#include <cstring>
 
 
 using namespace Escape;
 
+// Writes local counts in binary, with vertices and edges in the labels of the input graph.
+// mapping[v] is the label of input vertex v in the degree-ordered graph that was counted.
+//
+// Format (little-endian on the usual platforms):
+//   int64 nVertices, int64 nEdges, int64 nPatterns (= 11)
+//   nVertices x nPatterns doubles: row v has the counts for input vertex v
+//   nEdges x 2 int64: the edges (u,v), as input labels with u < v
+//   nEdges x nPatterns doubles: row e has the counts for edge e
+// Patterns are in the same order as the 4-vertex counts in out.txt.
+
+int writeLocalCounts(const char *path, CGraph *gout, LocalFourCounts &local, VertexIdx *mapping)
+{
+  FILE* f = fopen(path,"wb");
+  if (!f)
+  {
+      printf("could not write local counts to %s\n",path);
+      return 1;
+  }
+
+  VertexIdx *inverse = new VertexIdx[gout->nVertices+1];
+  for (VertexIdx v = 0; v < gout->nVertices; v++)
+      inverse[mapping[v]] = v;
+
+  int64_t header[3] = {gout->nVertices, gout->nEdges, 11};
+  fwrite(header, sizeof(int64_t), 3, f);
+  for (VertexIdx v = 0; v < gout->nVertices; v++)
+      fwrite(local.perVertex + 11*mapping[v], sizeof(double), 11, f);
+  for (VertexIdx i = 0; i < gout->nVertices; i++)
+      for (EdgeIdx pos = gout->offsets[i]; pos < gout->offsets[i+1]; pos++)
+      {
+          int64_t edge[2] = {std::min(inverse[i], inverse[gout->nbors[pos]]), std::max(inverse[i], inverse[gout->nbors[pos]])};
+          fwrite(edge, sizeof(int64_t), 2, f);
+      }
+  fwrite(local.perEdge, sizeof(double), 11*gout->nEdges, f);
+
+  delete[] inverse;
+  fclose(f);
+  return 0;
+}
+
+// Usage: count_four <graph> [-l <file>] [-p <patterns>]
+//   -l <file>: also write per-vertex and per-edge counts of all 4-vertex patterns to <file>
+//   -p <patterns>: comma separated list of 4-vertex patterns (e.g. "10" for 4-cliques), whose induced
+//                  counts are wanted. Only the non-induced counts these depend on are computed, the others
+//                  are written as nan. Ignored with -l.
 int main(int argc, char *argv[])
 {
+  const char *local_path = NULL;
+  PatternMask mask = allPatterns;
+  for (int i = 2; i < argc; i++)
+      if (strcmp(argv[i],"-l") == 0 && i+1 < argc)
+          local_path = argv[++i];
+      else if (strcmp(argv[i],"-p") == 0 && i+1 < argc)
+      {
+          PatternMask induced = parsePatternList(argv[++i], 11);
+          if (!induced)
+          {
+              printf("could not parse pattern list %s, patterns are numbered 0 to 10\n",argv[i]);
+              exit(1);
+          }
+          mask = fourNonInducedNeeded(induced);
+      }
+
   Graph g;
   if (loadGraph(argv[1], g, 1, IOFormat::escape))
     exit(1);
@@ -21,7 +83,8 @@ int main(int argc, char *argv[])
   printf("Converted to CSR\n");
 
   printf("Relabeling graph\n");
-  CGraph cg_relabel = cg.renameByDegreeOrder();
+  VertexIdx *mapping = new VertexIdx[cg.nVertices+1];
+  CGraph cg_relabel = cg.renameByDegreeOrder(mapping);
   cg_relabel.sortById();
   printf("Creating DAG\n");
   CDAG dag = degreeOrdered(&cg_relabel);
@@ -31,10 +94,19 @@ int main(int argc, char *argv[])
 
   double nonInd_three[4], nonInd_four[11];
 
-  printf("Counting 3-vertex\n");
-  getAllThree(&cg_relabel, &dag, nonInd_three);
-  printf("Counting 4-vertex\n");
-  getAllFour(&cg_relabel, &dag, nonInd_four);
+  printf("Counting 3-vertex and 4-vertex\n");
+  TriangleInfo tri_info;
+  if (local_path)
+  {
+      LocalFourCounts local = newLocalFourCounts(&(dag.outlist));
+      tri_info = getAllThreeAndFour(&cg_relabel, &dag, nonInd_three, nonInd_four, &local);
+      if (writeLocalCounts(local_path, &(dag.outlist), local, mapping))
+          exit(1);
+      delLocalFourCounts(local);
+  }
+  else
+      tri_info = getAllThreeAndFour(&cg_relabel, &dag, nonInd_three, nonInd_four, NULL, mask);
+  delTriangleInfo(tri_info);
 
 
   FILE* f = fopen("out.txt","w");
@@ -0,0 +1,87 @@
+#include "Escape/GraphIO.h"
+#include "Escape/EdgeHash.h"
+#include "Escape/Digraph.h"
+#include "Escape/PathSampling.h"
+#include <cstring>
+
+using namespace Escape;
+
+// Usage: estimate_counts <graph> <size> [-e <relative error>] [-n <samples>] [-s <seed>]
+//   size: 4 or 5
+//   -e <relative error>: sample until the 95% confidence intervals are within this fraction of the counts (default 0.01)
+//   -n <samples>: largest number of samples per sampler (default 100000000)
+//   -s <seed>: seed of the random generators (default: random)
+//
+// Writes the estimates to out.txt, in the format of count_four or count_five, and their
+// variances to var.txt, where line i has the variance of line i of out.txt.
+int main(int argc, char *argv[])
+{
+  if (argc < 3)
+  {
+      printf("usage: estimate_counts <graph> <size> [-e <relative error>] [-n <samples>] [-s <seed>]\n");
+      exit(1);
+  }
+  int size = atoi(argv[2]);
+  if (size != 4 && size != 5)
+  {
+      printf("size must be 4 or 5\n");
+      exit(1);
+  }
+  double rel_err = 0.01;
+  Count max_samples = 100000000;
+  uint64_t seed = randomSeed();
+  for (int i = 3; i < argc; i++)
+      if (strcmp(argv[i],"-e") == 0 && i+1 < argc)
+          rel_err = atof(argv[++i]);
+      else if (strcmp(argv[i],"-n") == 0 && i+1 < argc)
+          max_samples = atoll(argv[++i]);
+      else if (strcmp(argv[i],"-s") == 0 && i+1 < argc)
+          seed = strtoull(argv[++i], NULL, 10);
+  printf("Seed %llu\n", (unsigned long long) seed);
+
+  Graph g;
+  if (loadGraph(argv[1], g, 1, IOFormat::escape))
+    exit(1);
+
+  printf("Loaded graph\n");
+  CGraph cg = makeCSR(g);
+  cg.sortById();
+  printf("Converted to CSR\n");
+
+  printf("Creating DAG\n");
+  CDAG dag = degreeOrdered(&cg);
+  (dag.outlist).sortById();
+  (dag.inlist).sortById();
+
+  PatternEstimates est = estimateCounts(&cg, &dag, size, rel_err, max_samples, seed);
+  printf("Relative error %f after %lld samples\n", est.relErr, (long long) est.samples);
+
+  FILE* f = fopen("out.txt","w");
+  FILE* fv = fopen("var.txt","w");
+  if (!f || !fv)
+  {
+      printf("could not write to output to out.txt and var.txt\n");
+      return 0;
+  }
+  fprintf(f,"%lld\n",(long long) cg.nVertices);
+  fprintf(f,"%lld\n",(long long) (size == 5 ? cg.nEdges/2 : cg.nEdges));
+  fprintf(fv,"0\n0\n");
+  for(int i = 0; i < 4; i++)
+  {
+      fprintf(f,"%f\n",est.nonIndThree[i]);
+      fprintf(fv,"%f\n",est.varThree[i]);
+  }
+  for(int i = 0; i < 11; i++)
+  {
+      fprintf(f,"%f\n",est.nonIndFour[i]);
+      fprintf(fv,"%f\n",est.varFour[i]);
+  }
+  for(int i = 0; size == 5 && i < 34; i++)
+  {
+      fprintf(f,"%f\n",est.nonIndFive[i]);
+      fprintf(fv,"%f\n",est.varFive[i]);
+  }
+
+  fclose(f);
+  fclose(fv);
+}
@@ -9,6 +9,10 @@
 # DESIRED PATTERN SIZE: Either 3, 4, or 5
 # OPTIONAL FLAGS:
 #         -i: output counts as integers. Useful for small graphs, or for debugging
+#         -p <PATTERNS>: comma separated list of patterns of the desired size (numbered from 0,
+#             in the order of names below). Only these patterns are counted and reported.
+#         -a <ERROR>: estimate the counts by sampling (for size 4 or 5), until the 95% confidence
+#             intervals are within ERROR (e.g. 0.01) of the non-induced counts.
 #
 #
 # Output format:
@@ -134,7 +138,7 @@ matrices[5] = np.matrix(
 def main():
     if len(sys.argv) < 3:
         print(
-            "Format: python3 subgraph_counts.py <PATH FOR INPUT> <DESIRED PATTERN SIZE> <OPTIONS>\n DESIRED PATTERN SIZE: 3, 4, or 5\n OPTIONS:\n \t -i: for integer outputs, useful in looking at small graphs"
+            "Format: python3 subgraph_counts.py <PATH FOR INPUT> <DESIRED PATTERN SIZE> <OPTIONS>\n DESIRED PATTERN SIZE: 3, 4, or 5\n OPTIONS:\n \t -i: for integer outputs, useful in looking at small graphs\n \t -p <PATTERNS>: count only the given patterns (comma separated, e.g. 8,10)\n \t -a <ERROR>: estimate the counts by sampling, to the given relative error"
         )
         sys.exit()
 
@@ -144,12 +148,24 @@ def main():
 
     pattern = int(sys.argv[2])  # size of desired patterns
 
-    if pattern == 3:  # calling appropriate executable, output is in out.txt
+    requested = None  # indices of requested patterns, or None for all
+    if "-p" in sys.argv and pattern > 3:
+        pattern_list = sys.argv[sys.argv.index("-p") + 1]
+        requested = [int(p) for p in pattern_list.split(",")]
+
+    if "-a" in sys.argv and pattern > 3:  # estimates instead of exact counts
+        rel_err = sys.argv[sys.argv.index("-a") + 1]
+        os.system("../exe/estimate_counts " + sys.argv[1] + " " + str(pattern) + " -e " + rel_err)
+    elif pattern == 3:  # calling appropriate executable, output is in out.txt
         os.system("../exe/count_three " + sys.argv[1])
     elif pattern == 4:
-        os.system("../exe/count_four " + sys.argv[1])
+        os.system(
+            "../exe/count_four " + sys.argv[1] + ("" if requested is None else " -p " + pattern_list)
+        )
     elif pattern == 5:
-        os.system("../exe/count_five " + sys.argv[1])
+        os.system(
+            "../exe/count_five " + sys.argv[1] + ("" if requested is None else " -p " + pattern_list)
+        )
     else:
         print("Incorrect format: Desired pattern size must be 3, 4, or 5")
         sys.exit()
@@ -190,11 +206,21 @@ def main():
     induced[5] = list()
 
     for i in range(3, 6):
-        if len(noninduced[i]) > 0:
+        if len(noninduced[i]) > 0 and not np.isnan(noninduced[i]).any():
             induced[i] = np.linalg.solve(
                 matrices[i], noninduced[i]
             )  # inverting matrices[i] to convert non-induced to induced noninduced
 
+    if requested is not None:
+        # only the non-induced counts of patterns containing a requested pattern were computed (the others
+        # are nan). These only depend on induced counts of patterns that contain them, so solving the
+        # restricted system gives exact induced counts for the requested patterns.
+        counted = np.flatnonzero(~np.isnan(noninduced[pattern]))
+        induced[pattern] = np.full(len(noninduced[pattern]), np.nan)
+        induced[pattern][counted] = np.linalg.solve(
+            matrices[pattern][np.ix_(counted, counted)], noninduced[pattern][counted]
+        )
+
     print("==============")
     print("Basic size")
     print("==============")
@@ -203,12 +229,14 @@ def main():
     print("Edges\t\t", math.floor(m))
 
     for i in range(3, 6):
-        if len(induced[i]) == 0:
-            break
+        if len(induced[i]) == 0 or (requested is not None and i != pattern):
+            continue
         print("==============")
         print(str(i) + " vertex patterns")
         print("==============")
         for j in range(0, len(induced[i])):
+            if requested is not None and j not in requested:
+                continue
             if noninduced[i][j] == 0:
                 if integral:
                     print(
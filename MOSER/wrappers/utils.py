@@ -1,6 +1,7 @@
 import subprocess
 import psutil
 import time
+import numpy as np
 
 
 def run_command(command):
@@ -25,3 +26,18 @@ def run_command(command):
     result["time"] = str(exec_time)
     result["memory"] = memory_usage
     return result
+
+
+def read_local_counts(path):
+    """Reads the per-vertex and per-edge counts written by `count_four <graph> -l <path>`.
+
+    Returns (per_vertex, edges, per_edge): per_vertex[v] has the 11 non-induced 4-vertex
+    counts of copies containing vertex v, edges[e] = (u, v) with u < v, and per_edge[e]
+    the counts of copies using edge e. Patterns are in the order of names[4].
+    """
+    with open(path, "rb") as f:
+        n, m, p = np.fromfile(f, dtype=np.int64, count=3)
+        per_vertex = np.fromfile(f, dtype=np.float64, count=n * p).reshape(n, p)
+        edges = np.fromfile(f, dtype=np.int64, count=2 * m).reshape(m, 2)
+        per_edge = np.fromfile(f, dtype=np.float64, count=m * p).reshape(m, p)
+    return per_vertex, edges, per_edge